@@ -0,0 +1,237 @@
+#define _GNU_SOURCE
+#include <stdlib.h> // For: exit, malloc, free, qsort, EXIT_FAILURE
+#include <stdio.h>  // For: printf, perror
+#include <string.h> // For: memset, strtok, strcmp
+
+#include <float.h>  // For: FLT_EPSILON
+#include <math.h>   // For: fabs
+#include <unistd.h> // For: getopt
+
+#ifdef GETTIMEOFDAY
+#include <sys/time.h> // For struct timeval, gettimeofday
+#else
+#include <time.h> // For struct timespec, clock_gettime, CLOCK_MONOTONIC
+#endif
+
+#include "registry.h"
+#include "sgemm-timer.h"
+
+/* Every variant in one process, on the same operands: variants are timed in
+ * short batches, round after round, each round starting with the next
+ * variant, so drift of the clock frequency or temperature hits all of them. */
+
+extern void sgemm_(char*, char*, int*, int*, int*, float*, float*, int*, float*, int*, float*, float*, int*);
+
+/* C := A * B, computed with the BLAS */
+void reference_sgemm (int n, float* A, float* B, float* C)
+{
+  char N = 'N';
+  float one = 1, zero = 0;
+  sgemm_ (&N, &N, &n, &n, &n, &one, A, &n, B, &n, &zero, C, &n);
+}
+
+double wall_time ()
+{
+#if defined(TIMER_COUNTER)
+  return timer_seconds ();
+#elif defined(GETTIMEOFDAY)
+  struct timeval t;
+  gettimeofday (&t, NULL);
+  return 1.*t.tv_sec + 1.e-6*t.tv_usec;
+#else
+  struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return 1.*t.tv_sec + 1.e-9*t.tv_nsec;
+#endif
+}
+
+void die (const char* message)
+{
+  perror (message);
+  exit (EXIT_FAILURE);
+}
+
+void fill (float* p, int n)
+{
+  for (int i = 0; i < n; ++i)
+    p[i] = 2 * (float)rand () / (float)RAND_MAX - 1; // Uniformly distributed over [-1, 1]
+}
+
+float max_abs (float* p, int n)
+{
+  float m = 0;
+  for (int i = 0; i < n; ++i)
+    if (fabs (p[i]) > m)
+      m = fabs (p[i]);
+  return m;
+}
+
+int compare_double (const void* a, const void* b)
+{
+  double x = *(const double*) a, y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+/* C := A * B with the variant, checked against R = A * B from the BLAS:
+ * componentwise |C - R| <= 3 e_mach n (|A| |B|), with |A| |B| in P, or
+ * normwise for the variants that export an error bound */
+int check (const struct sgemm_variant* v, int n, float* A, float* B, float* C, float* R, float* P)
+{
+  memset (C, 0, (size_t)n * n * sizeof(float));
+  v->square_sgemm (n, A, B, C);
+  float normwise = v->error_bound ? v->error_bound (n) * FLT_EPSILON * max_abs (A, n * n) * max_abs (B, n * n) : 0;
+  for (int i = 0; i < n * n; ++i)
+    if (fabs (C[i] - R[i]) > (v->error_bound ? normwise : 3 * FLT_EPSILON * n * P[i]))
+      return 0;
+  return 1;
+}
+
+/* Calls of square_sgemm in one batch of at least 10 ms */
+int calibrate (const struct sgemm_variant* v, int n, float* A, float* B, float* C)
+{
+  int iterations = 1;
+  for (;;)
+  {
+    double seconds = -wall_time ();
+    for (int it = 0; it < iterations; ++it)
+      v->square_sgemm (n, A, B, C);
+    seconds += wall_time ();
+    if (seconds >= 0.01)
+      return iterations;
+    iterations *= 2;
+  }
+}
+
+void usage (const char* prog)
+{
+  fprintf (stderr, "usage: %s [-l] [-v variant,...] [-r rounds] [N]...\n", prog);
+  fprintf (stderr, "  -l  list the variants and exit\n");
+  fprintf (stderr, "  -v  only these variants, e.g. -v blocked,blocked-asm,blas (default all)\n");
+  fprintf (stderr, "  -r  rounds of interleaved batches per size (default 10)\n");
+  exit (EXIT_FAILURE);
+}
+
+int main (int argc, char** argv)
+{
+  int rounds = 10;
+  char* subset = NULL;
+  int opt;
+  while ((opt = getopt (argc, argv, "lv:r:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'l':
+      for (int i = 0; i < sgemm_nvariants; ++i)
+        printf ("%s\t%s\n", sgemm_variants[i].name, *sgemm_variants[i].desc);
+      return 0;
+    case 'v':
+      subset = optarg;
+      break;
+    case 'r':
+      rounds = atoi (optarg);
+      if (rounds < 1)
+        usage (argv[0]);
+      break;
+    default:
+      usage (argv[0]);
+    }
+  }
+
+  /* the selected variants, in registry order unless -v gives one */
+  const struct sgemm_variant** variants = (const struct sgemm_variant**) malloc (sgemm_nvariants * sizeof(*variants));
+  if (variants == NULL) die ("failed to allocate variant list");
+  int nv = 0;
+  if (subset == NULL)
+    for (int i = 0; i < sgemm_nvariants; ++i)
+      variants[nv++] = &sgemm_variants[i];
+  else
+    for (char* name = strtok (subset, ","); name; name = strtok (NULL, ","))
+    {
+      int i = 0;
+      while (i < sgemm_nvariants && strcmp (sgemm_variants[i].name, name) != 0)
+        ++i;
+      if (i == sgemm_nvariants)
+      {
+        fprintf (stderr, "unknown variant: %s (see -l)\n", name);
+        return EXIT_FAILURE;
+      }
+      if (nv < sgemm_nvariants)
+        variants[nv++] = &sgemm_variants[i];
+    }
+
+  int default_sizes[] = {64, 96, 127, 128, 256, 512, 1024};
+  int nsizes = argc > optind ? argc - optind : sizeof(default_sizes) / sizeof(default_sizes[0]);
+
+  int* iterations = (int*) malloc (nv * sizeof(int));
+  int* passed = (int*) malloc (nv * sizeof(int));
+  double* rates = (double*) malloc ((size_t)nv * rounds * sizeof(double));
+  if (iterations == NULL || passed == NULL || rates == NULL) die ("failed to allocate results");
+
+  for (int isize = 0; isize < nsizes; ++isize)
+  {
+    int n = argc > optind ? atoi (argv[optind + isize]) : default_sizes[isize];
+    if (n < 1)
+      usage (argv[0]);
+
+    /* the same operands for every variant */
+    float* buf = (float*) malloc (6 * (size_t)n * n * sizeof(float));
+    if (buf == NULL) die ("failed to allocate problem");
+    float* A = buf;
+    float* B = A + (size_t)n * n;
+    float* C = B + (size_t)n * n;
+    float* R = C + (size_t)n * n;
+    float* P = R + (size_t)n * n;
+    float* W = P + (size_t)n * n;
+    fill (A, n * n);
+    fill (B, n * n);
+    reference_sgemm (n, A, B, R);
+    /* P := |A| |B|, |A| goes through C, which the variants overwrite anyway */
+    for (int i = 0; i < n * n; ++i)
+    {
+      C[i] = fabs (A[i]);
+      W[i] = fabs (B[i]);
+    }
+    reference_sgemm (n, C, W, P);
+    printf ("Size: %d\n", n);
+
+    for (int j = 0; j < nv; ++j)
+    {
+      passed[j] = check (variants[j], n, A, B, C, R, P);
+      iterations[j] = passed[j] ? calibrate (variants[j], n, A, B, C) : 0;
+    }
+
+    /* round r starts with variant r, so no variant is always first or last */
+    for (int r = 0; r < rounds; ++r)
+      for (int jj = 0; jj < nv; ++jj)
+      {
+        int j = (jj + r) % nv;
+        if (!passed[j])
+          continue;
+        double seconds = -wall_time ();
+        for (int it = 0; it < iterations[j]; ++it)
+          variants[j]->square_sgemm (n, A, B, C);
+        seconds += wall_time ();
+        rates[j * rounds + r] = 2.e-9 * iterations[j] * n * n * n / seconds;
+      }
+
+    printf ("\tvariant\tmedian Gflop/s\tmin\tmax\n");
+    for (int j = 0; j < nv; ++j)
+    {
+      if (!passed[j])
+      {
+        printf ("\t%s\t*** FAILURE *** result exceeds the error bounds\n", variants[j]->name);
+        continue;
+      }
+      double* rate = rates + j * rounds;
+      qsort (rate, rounds, sizeof(double), compare_double);
+      printf ("\t%s\t%.3g\t%.3g\t%.3g\n", variants[j]->name, rate[rounds / 2], rate[0], rate[rounds - 1]);
+    }
+    free (buf);
+  }
+
+  free (rates);
+  free (passed);
+  free (iterations);
+  free (variants);
+  return 0;
+}
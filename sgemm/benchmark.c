@@ -1,9 +1,22 @@
+#define _GNU_SOURCE
 #include <stdlib.h> // For: exit, drand48, malloc, free, NULL, EXIT_FAILURE
 #include <stdio.h>  // For: perror
 #include <string.h> // For: memset
 
 #include <float.h>  // For: DBL_EPSILON
+#include <limits.h> // For: INT_MAX
 #include <math.h>   // For: fabs
+#include <unistd.h> // For: getopt, syscall
+#include <sched.h>  // For: sched_getaffinity, CPU_COUNT
+#include <pthread.h> // For: pthread_create, pthread_barrier_wait
+#include <fcntl.h>   // For: posix_fadvise
+
+#include <linux/perf_event.h> // For: perf_event_attr, PERF_COUNT_HW_CACHE_DTLB
+#include <sys/ioctl.h>        // For: ioctl
+#include <sys/syscall.h>      // For: __NR_perf_event_open
+#include "sgemm-alloc.h"      // For: page_alloc, page_free
+#include "sgemm-timer.h"      // For: timer_seconds, core_hz
+#include "sgemm-matrix.h"     // For: matrix_map, matrix_unmap
 
 #ifdef GETTIMEOFDAY
 #include <sys/time.h> // For struct timeval, gettimeofday
@@ -14,16 +27,14 @@
 /* reference_sgemm wraps a call to the BLAS-3 routine sgemm, via the standard FORTRAN interface - hence the reference semantics. */
 #define SGEMM sgemm_
 extern void SGEMM(char*, char*, int*, int*, int*, float*, float*, int*, float*, int*, float*, float*, int*);
-void reference_sgemm (int N, float ALPHA, float* A, float* B, float* C)
+void reference_sgemm (int M, int N, int K, float ALPHA, float* A, float* B, float* C)
 {
   char TRANSA = 'N';
   char TRANSB = 'N';
-  int M = N;
-  int K = N;
   float BETA = 1.;
-  int LDA = N;
-  int LDB = N;
-  int LDC = N;
+  int LDA = M;
+  int LDB = K;
+  int LDC = M;
   SGEMM(&TRANSA, &TRANSB, &M, &N, &K, &ALPHA, A, &LDA, B, &LDB, &BETA, C, &LDC);
 }
 
@@ -31,9 +42,46 @@ void reference_sgemm (int N, float ALPHA, float* A, float* B, float* C)
 extern const char* sgemm_desc;
 extern void square_sgemm (int, float*, float*, float*);
 
+/* Optional: variants that are not componentwise stable (e.g. Strassen) export
+ * a normwise bound f(n) such that max|C - fl(C)| <= f(n) * e_mach * max|A| * max|B|. */
+extern double sgemm_error_bound (int) __attribute__((weak));
+
+/* Optional: the pre-packed B API, timed in steady state when the variant provides it. */
+#include "sgemm.h"
+#pragma weak sgemm_pack_b
+#pragma weak sgemm_packed
+#pragma weak sgemm_packed_free
+
+/* Optional: rectangular shapes and per-thread accounting of the parallel variants. */
+#pragma weak sgemm_rect
+#pragma weak sgemm_thread_stats
+#pragma weak sgemm_thread_stats_reset
+#pragma weak sgemm_set_threads
+
+/* Optional: software prefetch distance of the kernel-based variants. */
+#pragma weak sgemm_set_prefetch
+
+/* Optional: denormals flushed to zero or kept, whatever the process mode. */
+#pragma weak sgemm_set_denormals
+
+/* Optional: operands in other layouts than column-major, or any strides. */
+#pragma weak sgemm_layout
+#pragma weak sgemm_strided
+
+/* Optional: ssyrk and strmm on the GEMM kernel, checked against the BLAS ones. */
+#pragma weak sgemm_syrk
+#pragma weak sgemm_trmm
+
+/* Optional: operands in files, multiplied out of core. */
+#pragma weak sgemm_file
+extern void ssyrk_(char*, char*, int*, int*, float*, float*, int*, float*, float*, int*);
+extern void strmm_(char*, char*, char*, char*, int*, int*, float*, float*, int*, float*, int*);
+
 double wall_time ()
 {
-#ifdef GETTIMEOFDAY
+#if defined(TIMER_COUNTER)
+  return timer_seconds ();
+#elif defined(GETTIMEOFDAY)
   struct timeval t;
   gettimeofday (&t, NULL);
   return 1.*t.tv_sec + 1.e-6*t.tv_usec;
@@ -77,11 +125,1032 @@ void absolute_value (float *p, int n)
     p[i] = fabs (p[i]);
 }
 
+float max_abs (float *p, int n)
+{
+  float m = 0;
+  for (int i = 0; i < n; ++i)
+    if (fabs (p[i]) > m)
+      m = fabs (p[i]);
+  return m;
+}
+
+/* A problem C(MxN) += A(MxK) * B(KxN); square when M == N == K */
+struct shape
+{
+  int m, n, k;
+};
+
+/* Parse "N" or "MxNxK" */
+int parse_shape (const char* arg, struct shape* s)
+{
+  int n = sscanf (arg, "%dx%dx%d", &s->m, &s->n, &s->k);
+  if (n == 1)
+    s->n = s->k = s->m;
+  else if (n != 3)
+    return 0;
+  return s->m > 0 && s->n > 0 && s->k > 0;
+}
+
+int is_square (struct shape s)
+{
+  return s.m == s.n && s.n == s.k;
+}
+
+/* Layouts of A, B and C given with -r, e.g. "RCR": row- or column-major */
+const char* layouts = NULL;
+
+/* Leading dimension of a rows-by-cols matrix stored in the given layout */
+int leading (char layout, int rows, int cols)
+{
+  return layout == 'R' ? cols : rows;
+}
+
+/* Rewrite a rows-by-cols matrix stored in the given layout as column-major, W is scratch */
+void to_column_major (char layout, int rows, int cols, float* X, float* W)
+{
+  if (layout != 'R')
+    return;
+  for (int j = 0; j < cols; ++j)
+    for (int i = 0; i < rows; ++i)
+      W[i + j * rows] = X[i * cols + j];
+  memcpy (X, W, (size_t)rows * cols * sizeof(float));
+}
+
+void multiply (struct shape s, float* A, float* B, float* C)
+{
+  if (layouts)
+    sgemm_layout (s.m, s.n, s.k, layouts[0], leading (layouts[0], s.m, s.k), A,
+                  layouts[1], leading (layouts[1], s.k, s.n), B, layouts[2], leading (layouts[2], s.m, s.n), C);
+  else if (is_square (s))
+    square_sgemm (s.n, A, B, C);
+  else
+    sgemm_rect (s.m, s.n, s.k, s.m, A, s.k, B, s.m, C);
+}
+
+/* Time a "sufficiently long" sequence of calls to reduce noise.
+ * Returns Gflop/s, always counted as 2mnk so that fast algorithms report an
+ * effective rate comparable to the classic one. */
+double time_multiply (struct shape s, float* A, float* B, float* C, int* iterations, double* elapsed)
+{
+  double Gflops_s, seconds = -1.0;
+  double timeout = 0.1; // "sufficiently long" := at least 1/10 second.
+  int    n_iterations = 0;
+  for (n_iterations = 1; seconds < timeout;)
+  {
+    /* Warm-up */
+    n_iterations *= 2;
+
+    multiply (s, A, B, C);
+    if (sgemm_thread_stats_reset)
+      sgemm_thread_stats_reset ();
+
+    /* Benchmark n_iterations runs of square_sgemm */
+    seconds = -wall_time();
+    for (int it = 0; it < n_iterations; ++it)
+      multiply (s, A, B, C);
+    seconds += wall_time();
+
+    /*  compute Mflop/s rate */
+    Gflops_s = 2.e-9 * n_iterations * s.m * s.n * s.k / seconds;
+  }
+  *iterations = n_iterations;
+  *elapsed = seconds;
+  return Gflops_s;
+}
+
+/* Size of the last level cache from sysfs, 64 MiB if the machine does not tell */
+size_t llc_bytes ()
+{
+  size_t largest = 0;
+  for (int index = 0; index < 8; ++index)
+  {
+    char path[64], unit = 0;
+    size_t size;
+    snprintf (path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+    FILE* f = fopen (path, "r");
+    if (f == NULL)
+      continue;
+    if (fscanf (f, "%zu%c", &size, &unit) >= 1)
+    {
+      size <<= unit == 'K' ? 10 : unit == 'M' ? 20 : 0;
+      if (size > largest)
+        largest = size;
+    }
+    fclose (f);
+  }
+  return largest ? largest : (size_t)64 << 20;
+}
+
+/* Like time_multiply, but call i uses operand set i % nsets of the pool, set
+ * j being A, B and C one after the other at pool + j * set. With the pool
+ * larger than the last level cache every call finds its operands in memory. */
+double time_multiply_cold (struct shape s, float* pool, size_t set, int nsets)
+{
+  double seconds = -1.0;
+  int n_iterations;
+  for (n_iterations = 1; seconds < 0.1;)
+  {
+    n_iterations *= 2;
+    seconds = -wall_time();
+    for (int it = 0; it < n_iterations; ++it)
+    {
+      float* A = pool + (it % nsets) * set;
+      float* B = A + (size_t)s.m * s.k;
+      float* C = B + (size_t)s.k * s.n;
+      multiply (s, A, B, C);
+    }
+    seconds += wall_time();
+  }
+  return 2.e-9 * n_iterations * s.m * s.n * s.k / seconds;
+}
+
+/* Bytes a streaming implementation moves per call: A and B read once, C read
+ * and written once. Skinny shapes (M or N up to 8) are bound by this, not by flops. */
+double traffic (struct shape s)
+{
+  return sizeof(float) * ((double)s.m * s.k + (double)s.k * s.n + 2. * s.m * s.n);
+}
+
+/* Counter of the dTLB load misses of this thread (not of the pool workers),
+ * -1 when the kernel does not let us count them, e.g. in a container. */
+int open_dtlb_counter ()
+{
+  struct perf_event_attr attr;
+  memset (&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* dTLB load misses per call over iterations calls, -1 without a counter */
+double dtlb_misses (int fd, struct shape s, float* A, float* B, float* C, int iterations)
+{
+  long long count;
+  if (fd < 0)
+    return -1;
+  ioctl (fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl (fd, PERF_EVENT_IOC_ENABLE, 0);
+  for (int it = 0; it < iterations; ++it)
+    multiply (s, A, B, C);
+  ioctl (fd, PERF_EVENT_IOC_DISABLE, 0);
+  if (read (fd, &count, sizeof(count)) != sizeof(count))
+    return -1;
+  return (double)count / iterations;
+}
+
+void print_misses (double misses)
+{
+  if (misses < 0)
+    printf ("	dTLB misses: n/a");
+  else
+    printf ("	dTLB misses: %.3g", misses);
+}
+
+/* C := C + A * A^T on the lower triangle, C is m-by-m and A m-by-k */
+void run_syrk (struct shape s, float* A, float* B, float* C, float* W)
+{
+  if (!sgemm_syrk ('L', s.m, s.k, s.m, A, s.m, C))
+    die ("failed to allocate syrk workspace");
+}
+
+/* B := L * B with L the lower triangle of A, m-by-m, and B m-by-n, restored from W first */
+void run_trmm (struct shape s, float* A, float* B, float* C, float* W)
+{
+  memcpy (B, W, (size_t)s.m * s.n * sizeof(float));
+  sgemm_trmm ('L', s.m, s.n, s.m, A, s.m, B);
+}
+
+/* Gflop/s of flops floating point operations per call to f, timed like time_multiply */
+double time_routine (void (*f) (struct shape, float*, float*, float*, float*), double flops,
+                     struct shape s, float* A, float* B, float* C, float* W)
+{
+  double seconds = -1.0;
+  int n_iterations;
+  for (n_iterations = 1; seconds < 0.1;)
+  {
+    n_iterations *= 2;
+    f (s, A, B, C, W);
+    seconds = -wall_time();
+    for (int it = 0; it < n_iterations; ++it)
+      f (s, A, B, C, W);
+    seconds += wall_time();
+  }
+  return 1.e-9 * n_iterations * flops / seconds;
+}
+
+/* Time sgemm_syrk and sgemm_trmm on the lower triangle, then check both
+ * triangles against the BLAS: syrk must leave the other triangle alone.
+ * Rates count the flops they need, m^2 k and m^2 n, half of the GEMM's.
+ * C is clobbered, B is restored, W is scratch of the same size. */
+void triangular (struct shape s, float* A, float* B, float* C, float* W)
+{
+  int m = s.m, n = s.n, k = s.k;
+  float one = 1, minus_one = -1;
+  char* uplos[] = {"L", "U"};
+  char left = 'L', no = 'N';
+
+  /* a fresh C, the one of the GEMM timing has grown large */
+  fill (W, m * m);
+  printf ("\tsyrk Gflop/s: %.3g", time_routine (run_syrk, (double)m * m * k, s, A, B, C, W));
+  for (int u = 0; u < 2; ++u)
+  {
+    memcpy (C, W, (size_t)m * m * sizeof(float));
+    if (!sgemm_syrk (*uplos[u], m, k, m, A, m, C))
+      die ("failed to allocate syrk workspace");
+    ssyrk_ (uplos[u], &no, &m, &k, &minus_one, A, &m, &one, C, &m);
+    float bound = 3 * FLT_EPSILON * (k * max_abs (A, m * k) * max_abs (A, m * k) + max_abs (W, m * m));
+    for (int j = 0; j < m; ++j)
+      for (int i = 0; i < m; ++i)
+      {
+        int inside = u == 0 ? i >= j : i <= j;
+        float d = fabs (C[i + j * m] - W[i + j * m]);
+        if (inside ? d > bound : d != 0)
+          die ("*** FAILURE *** sgemm_syrk differs from ssyrk.\n");
+      }
+  }
+
+  memcpy (W, B, (size_t)m * n * sizeof(float));
+  printf ("\ttrmm Gflop/s: %.3g", time_routine (run_trmm, (double)m * m * n, s, A, B, C, W));
+  for (int u = 0; u < 2; ++u)
+  {
+    memcpy (B, W, (size_t)m * n * sizeof(float));
+    memcpy (C, W, (size_t)m * n * sizeof(float));
+    sgemm_trmm (*uplos[u], m, n, m, A, m, B);
+    strmm_ (&left, uplos[u], &no, &no, &m, &n, &one, A, &m, C, &m);
+    float bound = 3 * FLT_EPSILON * m * max_abs (A, m * m) * max_abs (W, m * n);
+    for (int i = 0; i < m * n; ++i)
+      if (fabs (B[i] - C[i]) > bound)
+        die ("*** FAILURE *** sgemm_trmm differs from strmm.\n");
+  }
+  memcpy (B, W, (size_t)m * n * sizeof(float));
+}
+
+/* One more call through the handle the timing reused, on a fresh C, checked
+ * against the BLAS like sgemm_syrk and sgemm_trmm. C is clobbered, W is
+ * scratch of the same size. */
+void check_packed (struct shape s, const sgemm_packed_t* P, float* A, float* B, float* C, float* W)
+{
+  int m = s.m, n = s.n, k = s.k;
+  fill (W, m * n);
+  memcpy (C, W, (size_t)m * n * sizeof(float));
+  sgemm_packed (m, m, A, P, m, C);
+  reference_sgemm (m, n, k, -1., A, B, C);
+  float bound = 3 * FLT_EPSILON * (k * max_abs (A, m * k) * max_abs (B, k * n) + max_abs (W, m * n));
+  for (int i = 0; i < m * n; ++i)
+    if (fabs (C[i] - W[i]) > bound)
+      die ("*** FAILURE *** sgemm_packed differs from sgemm.\n");
+}
+
+/* Strong scaling times every shape on 1, 2, 4, ... up to max_threads threads,
+ * weak scaling grows M with the threads so every thread keeps the same work.
+ * Speedup is the rate against the one-thread rate, efficiency is speedup / threads. */
+void scaling (int weak, int max_threads, const char* affinity, struct shape* sizes, int nsizes)
+{
+  printf ("%s scaling, %s affinity, up to %d threads\n", weak ? "Weak" : "Strong", affinity, max_threads);
+  for (int isize = 0; isize < nsizes; ++isize)
+  {
+    struct shape s = sizes[isize];
+    if (weak)
+      printf ("\nSize: %dx%dx%d, M times the threads\n", s.m, s.n, s.k);
+    else if (is_square (s))
+      printf ("\nSize: %d\n", s.n);
+    else
+      printf ("\nSize: %dx%dx%d\n", s.m, s.n, s.k);
+    printf ("\tthreads\tGflop/s\tspeedup\tefficiency\n");
+
+    double base = 0;
+    for (int p = 1;; p *= 2)
+    {
+      if (p > max_threads)
+        p = max_threads;
+      if (!sgemm_set_threads (p, affinity))
+        die ("failed to set the thread pool");
+
+      struct shape t = s;
+      if (weak)
+        t.m = s.m * p;
+      float* A = (float*) malloc ((size_t)t.m * t.k * sizeof(float));
+      float* B = (float*) malloc ((size_t)t.k * t.n * sizeof(float));
+      float* C = (float*) malloc ((size_t)t.m * t.n * sizeof(float));
+      if (A == NULL || B == NULL || C == NULL) die ("failed to allocate scaling problem");
+      fill (A, t.m * t.k);
+      fill (B, t.k * t.n);
+      fill (C, t.m * t.n);
+
+      int n_iterations;
+      double seconds;
+      double Gflops_s = time_multiply (t, A, B, C, &n_iterations, &seconds);
+      if (p == 1)
+        base = Gflops_s;
+      double speedup = Gflops_s / base;
+      printf ("\t%d\t%.3g\t%.2f\t%.1f%%\n", p, Gflops_s, speedup, 100. * speedup / p);
+      free (A);
+      free (B);
+      free (C);
+      if (p == max_threads)
+        break;
+    }
+  }
+}
+
+/* One of the independent callers of the throughput mode: its own operands,
+ * first touched by itself, and the latency of every call it made. */
+struct worker
+{
+  struct shape s;
+  int cpu;
+  pthread_barrier_t* start;
+  double seconds;
+  int calls, capacity;
+  double* latency;
+};
+
+void* throughput_worker (void* arg)
+{
+  struct worker* w = (struct worker*) arg;
+  struct shape s = w->s;
+  if (w->cpu >= 0)
+  {
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    CPU_SET (w->cpu, &set);
+    pthread_setaffinity_np (pthread_self (), sizeof(set), &set);
+  }
+  float* A = (float*) malloc ((size_t)s.m * s.k * sizeof(float));
+  float* B = (float*) malloc ((size_t)s.k * s.n * sizeof(float));
+  float* C = (float*) malloc ((size_t)s.m * s.n * sizeof(float));
+  if (A == NULL || B == NULL || C == NULL) die ("failed to allocate worker operands");
+  fill (A, s.m * s.k);
+  fill (B, s.k * s.n);
+  fill (C, s.m * s.n);
+  multiply (s, A, B, C);
+
+  /* every worker calls for the same "sufficiently long" time, all at once */
+  pthread_barrier_wait (w->start);
+  double start = wall_time (), end = start;
+  w->calls = 0;
+  while (end - start < 0.2)
+  {
+    multiply (s, A, B, C);
+    double t = wall_time ();
+    if (w->calls == w->capacity)
+    {
+      w->capacity = w->capacity ? 2 * w->capacity : 1024;
+      w->latency = (double*) realloc (w->latency, w->capacity * sizeof(double));
+      if (w->latency == NULL) die ("failed to allocate latency samples");
+    }
+    w->latency[w->calls++] = t - end;
+    end = t;
+  }
+  w->seconds = end - start;
+  free (A);
+  free (B);
+  free (C);
+  return NULL;
+}
+
+int compare_double (const void* a, const void* b)
+{
+  double x = *(const double*) a, y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+/* Run nworkers independent single-threaded callers, worker i pinned to the
+ * i-th allowed cpu (wrapping around), and print one row of the table. */
+void run_workers (struct shape s, int nworkers)
+{
+  struct worker* workers = (struct worker*) calloc (nworkers, sizeof(struct worker));
+  pthread_t* threads = (pthread_t*) malloc (nworkers * sizeof(pthread_t));
+  if (workers == NULL || threads == NULL) die ("failed to allocate workers");
+  cpu_set_t allowed;
+  int ncpus = sched_getaffinity (0, sizeof(allowed), &allowed) == 0 ? CPU_COUNT (&allowed) : 0;
+  pthread_barrier_t start;
+  pthread_barrier_init (&start, NULL, nworkers);
+  for (int i = 0, cpu = -1; i < nworkers; ++i)
+  {
+    workers[i].s = s;
+    workers[i].start = &start;
+    workers[i].cpu = -1;
+    if (ncpus > 0)
+    {
+      /* next allowed cpu, wrapping around */
+      do
+        cpu = (cpu + 1) % CPU_SETSIZE;
+      while (!CPU_ISSET (cpu, &allowed));
+      workers[i].cpu = cpu;
+    }
+    pthread_create (&threads[i], NULL, throughput_worker, &workers[i]);
+  }
+
+  int calls = 0;
+  double seconds = 0;
+  for (int i = 0; i < nworkers; ++i)
+  {
+    pthread_join (threads[i], NULL);
+    calls += workers[i].calls;
+    if (workers[i].seconds > seconds)
+      seconds = workers[i].seconds;
+  }
+  double* latency = (double*) malloc (calls * sizeof(double));
+  if (latency == NULL) die ("failed to allocate latency samples");
+  for (int i = 0, n = 0; i < nworkers; ++i)
+  {
+    memcpy (latency + n, workers[i].latency, workers[i].calls * sizeof(double));
+    n += workers[i].calls;
+    free (workers[i].latency);
+  }
+  qsort (latency, calls, sizeof(double), compare_double);
+
+  /* aggregate rate over the slowest worker's time */
+  double Gflops_s = 2.e-9 * calls * s.m * s.n * s.k / seconds;
+  printf ("\t%d\t%d\t%.3g\t%.3g", nworkers, calls, Gflops_s, Gflops_s / nworkers);
+  double percentiles[] = {0.5, 0.9, 0.99};
+  for (int p = 0; p < 3; ++p)
+    printf ("\t%.3g", 1.e3 * latency[(int)(percentiles[p] * (calls - 1))]);
+  printf ("\t%.3g\n", 1.e3 * latency[calls - 1]);
+
+  pthread_barrier_destroy (&start);
+  free (latency);
+  free (threads);
+  free (workers);
+}
+
+/* Throughput of many concurrent single-threaded calls: one worker alone,
+ * then nworkers at once, so the per-worker rate shows what sharing the last
+ * level cache and the memory bandwidth costs. */
+void throughput (int nworkers, struct shape* sizes, int nsizes)
+{
+  printf ("Throughput of %d concurrent callers, latency in milliseconds\n", nworkers);
+  for (int isize = 0; isize < nsizes; ++isize)
+  {
+    struct shape s = sizes[isize];
+    if (is_square (s))
+      printf ("\nSize: %d\n", s.n);
+    else
+      printf ("\nSize: %dx%dx%d\n", s.m, s.n, s.k);
+    printf ("\tworkers\tcalls\tGflop/s\tper worker\tp50\tp90\tp99\tmax\n");
+    run_workers (s, 1);
+    if (nworkers > 1)
+      run_workers (s, nworkers);
+  }
+}
+
+/* Write count floats to path, uniform in [-1, 1] or zero, and drop them from
+ * the page cache so that the multiply reads them from storage */
+void write_matrix (const char* path, size_t count, int random)
+{
+  static float chunk[1 << 18];
+  FILE* f = fopen (path, "wb");
+  if (f == NULL) die (path);
+  for (size_t done = 0; done < count;)
+  {
+    size_t n = count - done < (1 << 18) ? count - done : (1 << 18);
+    if (random)
+      fill (chunk, (int)n);
+    else
+      memset (chunk, 0, n * sizeof(float));
+    if (fwrite (chunk, sizeof(float), n, f) != n) die (path);
+    done += n;
+  }
+  if (fflush (f) || fsync (fileno (f))) die (path);
+  posix_fadvise (fileno (f), 0, 0, POSIX_FADV_DONTNEED);
+  fclose (f);
+}
+
+/* Read-only view of a matrix file */
+float* map_file (const char* path, size_t count)
+{
+  int fd = open (path, O_RDONLY);
+  if (fd < 0) die (path);
+  float* p = (float*) mmap (NULL, count * sizeof(float), PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) die (path);
+  close (fd);
+  return p;
+}
+
+/* sgemm_file on A, B and a zero C written to dir, which may be larger than
+ * memory. Checked on random entries of C against dot products in double. */
+void out_of_core (const char* dir, struct shape* sizes, int nsizes)
+{
+  char a[4096], b[4096], c[4096];
+  snprintf (a, sizeof(a), "%s/sgemm-A.bin", dir);
+  snprintf (b, sizeof(b), "%s/sgemm-B.bin", dir);
+  snprintf (c, sizeof(c), "%s/sgemm-C.bin", dir);
+  for (int isize = 0; isize < nsizes; ++isize)
+  {
+    struct shape s = sizes[isize];
+    size_t m = s.m, n = s.n, k = s.k;
+    write_matrix (a, m * k, 1);
+    write_matrix (b, k * n, 1);
+    write_matrix (c, m * n, 0);
+
+    double seconds = -wall_time ();
+    if (!sgemm_file (s.m, s.n, s.k, a, b, c))
+      die ("failed to map the matrix files or bad SGEMM_OOC_MEMORY");
+    seconds += wall_time ();
+    printf ("Size: %dx%dx%d\tout of core Gflop/s: %.3g (%.3f seconds, %.3g GB of operands)\n", s.m, s.n, s.k,
+            2.e-9 * m * n * k / seconds, seconds, 1.e-9 * sizeof(float) * (m * k + k * n + m * n));
+
+    float* A = map_file (a, m * k);
+    float* B = map_file (b, k * n);
+    float* C = map_file (c, m * n);
+    for (int sample = 0; sample < 64; ++sample)
+    {
+      size_t i = rand () % m, j = rand () % n;
+      double dot = 0, bound = 0;
+      for (size_t p = 0; p < k; ++p)
+      {
+        dot += (double)A[i + p * m] * B[p + j * k];
+        bound += fabs (A[i + p * m] * B[p + j * k]);
+      }
+      if (fabs (C[i + j * m] - dot) > 3 * FLT_EPSILON * k * bound)
+        die ("*** FAILURE *** Error in out of core multiply exceeds componentwise error bounds.\n");
+    }
+    munmap (A, m * k * sizeof(float));
+    munmap (B, k * n * sizeof(float));
+    munmap (C, m * n * sizeof(float));
+  }
+  unlink (a);
+  unlink (b);
+  unlink (c);
+
+  /* Degenerate shapes leave C alone without opening the (now missing) files,
+   * negative ones are rejected */
+  if (!sgemm_file (0, 16, 16, a, b, c) || !sgemm_file (16, 0, 16, a, b, c) || !sgemm_file (16, 16, 0, a, b, c))
+    die ("*** FAILURE *** sgemm_file failed on a shape with a zero dimension.\n");
+  if (sgemm_file (-1, 16, 16, a, b, c))
+    die ("*** FAILURE *** sgemm_file accepted a negative dimension.\n");
+}
+
+/* One call of a replayed trace, or of captured operands: the shape and the
+ * strides of A, B and C, element (i, j) of X at X[i * rs + j * cs] */
+struct call
+{
+  struct shape s;
+  int rsa, csa, rsb, csb, rsc, csc;
+};
+
+int column_major (const struct call* c)
+{
+  return c->rsa == 1 && c->rsb == 1 && c->rsc == 1;
+}
+
+/* The call through the narrowest entry point that takes its strides */
+void replay (const struct call* c, float* A, float* B, float* C)
+{
+  struct shape s = c->s;
+  if (!column_major (c))
+    sgemm_strided (s.m, s.n, s.k, A, c->rsa, c->csa, B, c->rsb, c->csb, C, c->rsc, c->csc);
+  else if (is_square (s) && c->csa == s.n && c->csb == s.n && c->csc == s.n)
+    square_sgemm (s.n, A, B, C);
+  else
+    sgemm_rect (s.m, s.n, s.k, c->csa, A, c->csb, B, c->csc, C);
+}
+
+/* Whether this variant has an entry point for the call */
+int replayable (const struct call* c)
+{
+  if (!column_major (c))
+    return sgemm_strided != NULL;
+  return sgemm_rect != NULL || (is_square (c->s) && c->csa == c->s.n && c->csb == c->s.n && c->csc == c->s.n);
+}
+
+/* Read a call trace: one call per line, "M N K" for packed column-major
+ * operands or "M N K rsa csa rsb csb rsc csc", further fields (the time and
+ * thread of a captured call) are ignored, as are lines starting with '#'.
+ * Returns the number of calls, *calls allocated with malloc. */
+int read_trace (const char* path, struct call** calls)
+{
+  FILE* f = fopen (path, "r");
+  if (f == NULL) die (path);
+  int ncalls = 0, capacity = 0;
+  *calls = NULL;
+  char line[1024];
+  for (int lineno = 1; fgets (line, sizeof(line), f); ++lineno)
+  {
+    if (line[0] == '#' || line[strspn (line, " \t\r\n")] == '\0')
+      continue;
+    struct call c;
+    int n = sscanf (line, "%d %d %d %d %d %d %d %d %d", &c.s.m, &c.s.n, &c.s.k,
+                    &c.rsa, &c.csa, &c.rsb, &c.csb, &c.rsc, &c.csc);
+    if (n == 3)
+    {
+      c.rsa = c.rsb = c.rsc = 1;
+      c.csa = c.s.m;
+      c.csb = c.s.k;
+      c.csc = c.s.m;
+    }
+    if ((n != 3 && n < 9) || c.s.m < 1 || c.s.n < 1 || c.s.k < 1 ||
+        c.rsa < 1 || c.csa < 1 || c.rsb < 1 || c.csb < 1 || c.rsc < 1 || c.csc < 1)
+    {
+      fprintf (stderr, "%s:%d: not a call\n", path, lineno);
+      exit (EXIT_FAILURE);
+    }
+    if (!replayable (&c))
+    {
+      fprintf (stderr, "%s:%d: this variant has no entry point for these strides\n", path, lineno);
+      exit (EXIT_FAILURE);
+    }
+    if (ncalls == capacity)
+    {
+      capacity = capacity ? 2 * capacity : 1024;
+      *calls = (struct call*) realloc (*calls, capacity * sizeof(struct call));
+      if (*calls == NULL) die ("failed to allocate trace");
+    }
+    (*calls)[ncalls++] = c;
+  }
+  fclose (f);
+  return ncalls;
+}
+
+/* Replay the calls of a trace in order on random operands, once to warm up
+ * and once timed call by call, so a sequence of shapes from production runs
+ * with the cache state it leaves behind */
+void replay_trace (const char* path)
+{
+  struct call* calls;
+  int ncalls = read_trace (path, &calls);
+  if (ncalls == 0)
+  {
+    fprintf (stderr, "%s: no calls\n", path);
+    exit (EXIT_FAILURE);
+  }
+
+  /* one buffer per operand, large enough for the largest span in the trace */
+  size_t na = 0, nb = 0, nc = 0;
+  for (int i = 0; i < ncalls; ++i)
+  {
+    struct call* c = &calls[i];
+    size_t a = matrix_extent (c->s.m, c->s.k, c->rsa, c->csa);
+    size_t b = matrix_extent (c->s.k, c->s.n, c->rsb, c->csb);
+    size_t d = matrix_extent (c->s.m, c->s.n, c->rsc, c->csc);
+    if (a > na) na = a;
+    if (b > nb) nb = b;
+    if (d > nc) nc = d;
+  }
+  float* A = (float*) malloc (na * sizeof(float));
+  float* B = (float*) malloc (nb * sizeof(float));
+  float* C = (float*) malloc (nc * sizeof(float));
+  double* latency = (double*) malloc (ncalls * sizeof(double));
+  if (A == NULL || B == NULL || C == NULL || latency == NULL) die ("failed to allocate trace operands");
+  fill (A, (int)na);
+  fill (B, (int)nb);
+  fill (C, (int)nc);
+
+  for (int i = 0; i < ncalls; ++i)
+    replay (&calls[i], A, B, C);
+  double flops = 0;
+  for (int i = 0; i < ncalls; ++i)
+  {
+    double seconds = -wall_time ();
+    replay (&calls[i], A, B, C);
+    seconds += wall_time ();
+    latency[i] = seconds;
+    flops += 2. * calls[i].s.m * calls[i].s.n * calls[i].s.k;
+  }
+
+  printf ("Replay of %s, %d calls\n", path, ncalls);
+  printf ("\tcall\tshape\tstrides A, B, C\tmicroseconds\tGflop/s\n");
+  double total = 0;
+  for (int i = 0; i < ncalls; ++i)
+  {
+    struct call* c = &calls[i];
+    printf ("\t%d\t%dx%dx%d\t%d,%d %d,%d %d,%d\t%.3g\t%.3g\n", i, c->s.m, c->s.n, c->s.k,
+            c->rsa, c->csa, c->rsb, c->csb, c->rsc, c->csc, 1.e6 * latency[i], 2.e-9 * c->s.m * c->s.n * c->s.k / latency[i]);
+    total += latency[i];
+  }
+  qsort (latency, ncalls, sizeof(double), compare_double);
+  printf ("Total: %.3g seconds\tGflop/s: %.3g\tmicroseconds p50: %.3g\tp99: %.3g\tmax: %.3g\n", total, 1.e-9 * flops / total,
+          1.e6 * latency[(int)(0.5 * (ncalls - 1))], 1.e6 * latency[(int)(0.99 * (ncalls - 1))], 1.e6 * latency[ncalls - 1]);
+
+  free (latency);
+  free (A);
+  free (B);
+  free (C);
+  free (calls);
+}
+
+/* Gather the rows-by-cols matrix with strides rs and cs into column-major W */
+void gather (int rows, int cols, const float* X, int64_t rs, int64_t cs, float* W)
+{
+  for (int j = 0; j < cols; ++j)
+    for (int i = 0; i < rows; ++i)
+      W[i + (size_t)j * rows] = X[i * rs + j * cs];
+}
+
+/* Time C := A * B on operands captured to matrix files, used in place from
+ * the mapping, and check the product like the sweep does */
+void replay_operands (const char* files)
+{
+  char a[4096], b[4096];
+  if (sscanf (files, "%4095[^,],%4095s", a, b) != 2)
+  {
+    fprintf (stderr, "-m takes two matrix files, A and B, separated by a comma\n");
+    exit (EXIT_FAILURE);
+  }
+  struct matrix MA, MB;
+  if (!matrix_map (a, &MA))
+  {
+    fprintf (stderr, "%s: not a matrix file or truncated\n", a);
+    exit (EXIT_FAILURE);
+  }
+  if (!matrix_map (b, &MB))
+  {
+    fprintf (stderr, "%s: not a matrix file or truncated\n", b);
+    exit (EXIT_FAILURE);
+  }
+  if (MA.h.cols != MB.h.rows)
+  {
+    fprintf (stderr, "A is %ldx%ld, B is %ldx%ld: inner dimensions differ\n",
+             (long)MA.h.rows, (long)MA.h.cols, (long)MB.h.rows, (long)MB.h.cols);
+    exit (EXIT_FAILURE);
+  }
+  if (MA.h.rows > INT_MAX || MA.h.cols > INT_MAX || MB.h.cols > INT_MAX || MA.h.rs > INT_MAX || MA.h.cs > INT_MAX ||
+      MB.h.rs > INT_MAX || MB.h.cs > INT_MAX)
+  {
+    fprintf (stderr, "matrices too large for the int interface\n");
+    exit (EXIT_FAILURE);
+  }
+
+  struct call c;
+  c.s.m = MA.h.rows;
+  c.s.k = MA.h.cols;
+  c.s.n = MB.h.cols;
+  c.rsa = MA.h.rs;
+  c.csa = MA.h.cs;
+  c.rsb = MB.h.rs;
+  c.csb = MB.h.cs;
+  c.rsc = 1;
+  c.csc = c.s.m;
+  if (!replayable (&c))
+  {
+    fprintf (stderr, "this variant has no entry point for the strides of these operands\n");
+    exit (EXIT_FAILURE);
+  }
+  int m = c.s.m, n = c.s.n, k = c.s.k;
+  float* C = (float*) calloc ((size_t)m * n, sizeof(float));
+  float* W = (float*) malloc (((size_t)m * k + (size_t)k * n) * sizeof(float));
+  if (C == NULL || W == NULL) die ("failed to allocate result");
+
+  /* per-call latency over a "sufficiently long" run, after one warm-up call */
+  replay (&c, MA.data, MB.data, C);
+  int ncalls = 0, capacity = 0;
+  double* latency = NULL;
+  for (double start = wall_time (), end = start; end - start < 0.1;)
+  {
+    replay (&c, MA.data, MB.data, C);
+    double t = wall_time ();
+    if (ncalls == capacity)
+    {
+      capacity = capacity ? 2 * capacity : 1024;
+      latency = (double*) realloc (latency, capacity * sizeof(double));
+      if (latency == NULL) die ("failed to allocate latency samples");
+    }
+    latency[ncalls++] = t - end;
+    end = t;
+  }
+  qsort (latency, ncalls, sizeof(double), compare_double);
+  double median = latency[ncalls / 2];
+  printf ("Operands: %s (%c) x %s (%c)\tSize: %dx%dx%d\tGflop/s: %.3g (%d calls, microseconds min %.3g, p50 %.3g, max %.3g)\n",
+          a, MA.h.layout, b, MB.h.layout, m, n, k, 2.e-9 * m * n * k / median, ncalls,
+          1.e6 * latency[0], 1.e6 * median, 1.e6 * latency[ncalls - 1]);
+
+  /* C := A * B - A * B must be within 3 e_mach k |A| |B| of zero */
+  memset (C, 0, (size_t)m * n * sizeof(float));
+  replay (&c, MA.data, MB.data, C);
+  float* GA = W;
+  float* GB = W + (size_t)m * k;
+  gather (m, k, MA.data, MA.h.rs, MA.h.cs, GA);
+  gather (k, n, MB.data, MB.h.rs, MB.h.cs, GB);
+  reference_sgemm (m, n, k, -1., GA, GB, C);
+  absolute_value (GA, m * k);
+  absolute_value (GB, k * n);
+  absolute_value (C, m * n);
+  reference_sgemm (m, n, k, -3.*FLT_EPSILON*k, GA, GB, C);
+  for (size_t i = 0; i < (size_t)m * n; ++i)
+    if (C[i] > 0)
+      die ("*** FAILURE *** Error in matrix multiply exceeds componentwise error bounds.\n");
+
+  free (latency);
+  free (W);
+  free (C);
+  matrix_unmap (&MA);
+  matrix_unmap (&MB);
+}
+
+/* Operands full of denormals: A below FLT_MIN, B in [-1, 1] and C zero, so
+ * the inputs of every multiply and most partial sums are denormal. Timed with
+ * denormals kept and flushed; returns the rate kept, *flushed the other one. */
+double time_denormal (struct shape s, double* flushed)
+{
+  float* A = (float*) malloc ((size_t)s.m * s.k * sizeof(float));
+  float* B = (float*) malloc ((size_t)s.k * s.n * sizeof(float));
+  float* C = (float*) calloc ((size_t)s.m * s.n, sizeof(float));
+  if (A == NULL || B == NULL || C == NULL) die ("failed to allocate denormal operands");
+  fill (A, s.m * s.k);
+  for (int i = 0; i < s.m * s.k; ++i)
+    A[i] *= FLT_MIN / 2;
+  fill (B, s.k * s.n);
+
+  int n_iterations;
+  double seconds;
+  sgemm_set_denormals (0);
+  double kept = time_multiply (s, A, B, C, &n_iterations, &seconds);
+  sgemm_set_denormals (1);
+  *flushed = time_multiply (s, A, B, C, &n_iterations, &seconds);
+  sgemm_set_denormals (-1);
+  free (A);
+  free (B);
+  free (C);
+  return kept;
+}
+
+void usage (const char* prog)
+{
+  fprintf (stderr, "usage: %s [-b] [-g] [-H] [-l] [-r layouts] [-t threads] [-a affinity] [-S strong|weak] [-T workers] [-c] [-O dir] [-R trace] [-m A,B] [-d] [-p distance] [N | MxNxK]...\n", prog);
+  fprintf (stderr, "  -b  report per-thread busy time of the parallel variants\n");
+  fprintf (stderr, "  -g  report GB/s of matrix traffic instead of Gflop/s, for matrix-vector like shapes\n");
+  fprintf (stderr, "  -H  operands on 4 KiB pages, timed again on 2 MiB pages, with dTLB misses per call of both\n");
+  fprintf (stderr, "      (SGEMM_HUGEPAGES=hugetlb takes them from the reserved pool, the workspaces follow it too)\n");
+  fprintf (stderr, "  -r  layouts of A, B and C, each R (row-major) or C (column-major), e.g. -r RCC\n");
+  fprintf (stderr, "  -l  also time and check sgemm_syrk (m-by-k A) and sgemm_trmm (m-by-m A, m-by-n B)\n");
+  fprintf (stderr, "  -t  threads of the parallel variants, default one per allowed cpu\n");
+  fprintf (stderr, "  -a  placement of the threads: numa (default), compact or scatter\n");
+  fprintf (stderr, "  -S  strong or weak scaling sweep over 1, 2, 4, ... threads, with speedup and efficiency\n");
+  fprintf (stderr, "  -T  throughput of this many concurrent single-threaded callers, with latency percentiles\n");
+  fprintf (stderr, "  -c  also time with cold caches, rotating through operand sets twice the size of the last level cache\n");
+  fprintf (stderr, "  -O  multiply out of core, operands in files in dir (shapes must be given)\n");
+  fprintf (stderr, "  -R  replay a call trace (lines of M N K [rsa csa rsb csb rsc csc]) and time every call\n");
+  fprintf (stderr, "  -m  time and check C = A * B on operands captured to two matrix files\n");
+  fprintf (stderr, "  -d  also time on denormal operands, with denormals kept and flushed to zero\n");
+  fprintf (stderr, "  -p  run with this software prefetch distance, and again without prefetch\n");
+  exit (EXIT_FAILURE);
+}
+
+/* Per-thread busy time accumulated over the timed calls, and the imbalance
+ * max/mean: 1.00 means every thread did the same amount of work. */
+void report_threads (double seconds)
+{
+  if (!sgemm_thread_stats)
+  {
+    printf ("\tno per-thread accounting in this variant\n");
+    return;
+  }
+  double busy[256];
+  int tasks[256], steals[256];
+  int nthreads = sgemm_thread_stats (256, busy, tasks, steals);
+  if (nthreads > 256)
+    nthreads = 256;
+  double sum = 0, max = 0;
+  for (int t = 0; t < nthreads; ++t)
+  {
+    printf ("\tthread %d: busy %.3f seconds (%.1f%%), %d tasks, %d stolen\n", t, busy[t], 100. * busy[t] / seconds, tasks[t], steals[t]);
+    sum += busy[t];
+    if (busy[t] > max)
+      max = busy[t];
+  }
+  if (nthreads > 0 && sum > 0)
+    printf ("\timbalance (max/mean busy): %.2f\n", max * nthreads / sum);
+}
+
 /* The benchmarking program */
 int main (int argc, char **argv)
 {
+  int busy_report = 0;
+  int bandwidth = 0;
+  int level3 = 0;
+  int prefetch = -1;
+  int pages = 0;
+  int threads = 0;
+  const char* affinity = NULL;
+  const char* sweep = NULL;
+  int workers = 0;
+  int cold = 0;
+  int denormal = 0;
+  const char* ooc_dir = NULL;
+  const char* trace = NULL;
+  const char* operands = NULL;
+  int opt;
+  while ((opt = getopt (argc, argv, "bgHlr:p:t:a:S:T:cO:R:m:d")) != -1)
+  {
+    switch (opt)
+    {
+    case 'b':
+      busy_report = 1;
+      break;
+    case 'g':
+      bandwidth = 1;
+      break;
+    case 'H':
+      pages = 1;
+      break;
+    case 'l':
+      level3 = 1;
+      if (!sgemm_syrk || !sgemm_trmm)
+      {
+        fprintf (stderr, "this variant has no sgemm_syrk and sgemm_trmm\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'r':
+      layouts = optarg;
+      if (strlen (layouts) != 3 || strspn (layouts, "RC") != 3)
+        usage (argv[0]);
+      if (!sgemm_layout)
+      {
+        fprintf (stderr, "this variant has no sgemm_layout\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'p':
+      prefetch = atoi (optarg);
+      if (!sgemm_set_prefetch)
+      {
+        fprintf (stderr, "this variant has no software prefetch\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 't':
+      threads = atoi (optarg);
+      if (threads < 1)
+        usage (argv[0]);
+      break;
+    case 'a':
+      affinity = optarg;
+      break;
+    case 'S':
+      sweep = optarg;
+      if (strcmp (sweep, "strong") != 0 && strcmp (sweep, "weak") != 0)
+        usage (argv[0]);
+      break;
+    case 'c':
+      cold = 1;
+      break;
+    case 'd':
+      denormal = 1;
+      if (!sgemm_set_denormals)
+      {
+        fprintf (stderr, "this variant has no denormal mode\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'O':
+      ooc_dir = optarg;
+      if (!sgemm_file)
+      {
+        fprintf (stderr, "this variant has no sgemm_file\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'R':
+      trace = optarg;
+      break;
+    case 'm':
+      operands = optarg;
+      break;
+    case 'T':
+      workers = atoi (optarg);
+      if (workers < 1)
+        usage (argv[0]);
+      /* the parallel variants have one shared pool, their calls cannot overlap */
+      if (sgemm_set_threads)
+      {
+        fprintf (stderr, "this variant is not reentrant, use a single-threaded one\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      usage (argv[0]);
+    }
+  }
+  if ((threads || affinity || sweep) && !sgemm_set_threads)
+  {
+    fprintf (stderr, "this variant has no thread pool\n");
+    return EXIT_FAILURE;
+  }
+  if (threads || affinity || sweep)
+  {
+    if (affinity == NULL)
+      affinity = "numa";
+    if (!sgemm_set_threads (threads, affinity))
+      usage (argv[0]);
+  }
+
   printf ("Description:\t%s\n\n", sgemm_desc);
 
+  if (trace || operands)
+  {
+    if (operands)
+      replay_operands (operands);
+    if (trace)
+      replay_trace (trace);
+    return 0;
+  }
+
   /* Test sizes should highlight performance dips at multiples of certain powers-of-two */
   float initial = randint(1,10);
   int test_sizes[] =
@@ -93,84 +1162,250 @@ int main (int argc, char **argv)
  // { 31, 32, 96, 97, 127, 128, 129, 191, 192, 229, 255, 256, 257,
  //   319, 320, 321, 417, 479, 480, 511, 512, 639, 640, 767, 768, 769 };
 
-  int nsizes = sizeof(test_sizes)/sizeof(test_sizes[0]);
+  /* Shapes given on the command line replace the default sweep */
+  int nsizes = argc > optind ? argc - optind : sizeof(test_sizes)/sizeof(test_sizes[0]);
+  struct shape* sizes = (struct shape*) malloc (nsizes * sizeof(struct shape));
+  if (sizes == NULL) die ("failed to allocate size list");
+  for (int i = 0; i < nsizes; ++i)
+  {
+    if (argc <= optind)
+      sizes[i].m = sizes[i].n = sizes[i].k = test_sizes[i];
+    else if (!parse_shape (argv[optind + i], &sizes[i]))
+    {
+      fprintf (stderr, "invalid size: %s\n", argv[optind + i]);
+      usage (argv[0]);
+    }
+    if (!is_square (sizes[i]) && !sgemm_rect && !layouts)
+    {
+      fprintf (stderr, "%s: this variant only supports square matrices\n", argv[optind + i]);
+      return EXIT_FAILURE;
+    }
+  }
 
-  /* assume last size is also the largest size */
-  int nmax = test_sizes[nsizes-1];
+  if (sweep)
+  {
+    /* up to -t threads, or one per cpu we may run on */
+    cpu_set_t allowed;
+    if (threads == 0)
+      threads = sched_getaffinity (0, sizeof(allowed), &allowed) == 0 ? CPU_COUNT (&allowed) : 1;
+    scaling (strcmp (sweep, "weak") == 0, threads, affinity, sizes, nsizes);
+    free (sizes);
+    return 0;
+  }
+
+  if (ooc_dir)
+  {
+    if (argc <= optind)
+      usage (argv[0]);
+    out_of_core (ooc_dir, sizes, nsizes);
+    free (sizes);
+    return 0;
+  }
+
+  if (workers)
+  {
+    throughput (workers, sizes, nsizes);
+    free (sizes);
+    return 0;
+  }
+
+  /* find the largest dimension */
+  int nmax = 0;
+  for (int i = 0; i < nsizes; ++i)
+  {
+    if (sizes[i].m > nmax) nmax = sizes[i].m;
+    if (sizes[i].n > nmax) nmax = sizes[i].n;
+    if (sizes[i].k > nmax) nmax = sizes[i].k;
+  }
 
   /* allocate memory for all problems */
   float* buf = NULL;
-  buf = (float*) malloc (3 * nmax * nmax * sizeof(float));
+  float* huge = NULL;
+  int nbuf = level3 || layouts || sgemm_pack_b ? 4 : 3;
+  size_t bytes = nbuf * (size_t)nmax * nmax * sizeof(float);
+  int dtlb = -1;
+  if (pages)
+  {
+    /* the same operands twice, the huge copy only ever timed */
+    buf = (float*) page_alloc (bytes, PAGES_SMALL);
+    huge = (float*) page_alloc (bytes, page_policy () == PAGES_HUGETLB ? PAGES_HUGETLB : PAGES_THP);
+    if (huge == NULL) die ("failed to allocate huge page copy");
+    dtlb = open_dtlb_counter ();
+  }
+  else
+    buf = (float*) malloc (bytes);
   if (buf == NULL) die ("failed to allocate largest problem size");
 
+  /* operand sets for the cold runs, filled once and carved up per size */
+  float* cold_pool = NULL;
+  size_t cold_floats = 0;
+  if (cold)
+  {
+    cold_floats = 2 * llc_bytes () / sizeof(float);
+    if (cold_floats < 6 * (size_t)nmax * nmax)
+      cold_floats = 6 * (size_t)nmax * nmax;
+    cold_pool = (float*) malloc (cold_floats * sizeof(float));
+    if (cold_pool == NULL) die ("failed to allocate cold operand pool");
+    fill (cold_pool, (int)cold_floats);
+  }
+
   /* For each test size */
-  for (int isize = 0; isize < sizeof(test_sizes)/sizeof(test_sizes[0]); ++isize)
+  for (int isize = 0; isize < nsizes; ++isize)
   {
     /* Create and fill 3 random matrices A,B,C*/
-    int n = test_sizes[isize];
+    struct shape s = sizes[isize];
+    int m = s.m, n = s.n, k = s.k;
 
     float* A = buf + 0;
-    float* B = A + nmax*nmax;
-    float* C = B + nmax*nmax;
+    float* B = A + (size_t)nmax*nmax;
+    float* C = B + (size_t)nmax*nmax;
 
-    fill (A, n*n);
-    fill (B, n*n);
-    fill (C, n*n);
+    fill (A, m*k);
+    fill (B, k*n);
+    fill (C, m*n);
 
     /* Measure performance (in Gflops/s). */
+    double Gflops_s, seconds, prefetch_off = 0;
+    int n_iterations;
+    if (prefetch >= 0)
+    {
+      sgemm_set_prefetch (0);
+      prefetch_off = time_multiply (s, A, B, C, &n_iterations, &seconds);
+      sgemm_set_prefetch (prefetch);
+    }
+    /* core clock around the timing, for a rate per cycle that turbo and DVFS do not move */
+    double hz = core_hz (1 << 23);
+    Gflops_s = time_multiply (s, A, B, C, &n_iterations, &seconds);
+    hz = (hz + core_hz (1 << 23)) / 2;
 
-    /* Time a "sufficiently long" sequence of calls to reduce noise */
-    double Gflops_s, seconds = -1.0;
-    double timeout = 0.1; // "sufficiently long" := at least 1/10 second.
-    int    n_iterations = 0;
-    for (n_iterations = 1; seconds < timeout;)
+    const char* unit = "Gflop/s";
+    double rate = Gflops_s;
+    if (bandwidth)
     {
-      /* Warm-up */
-      n_iterations *= 2;
+      unit = "GB/s";
+      rate = 1.e-9 * n_iterations * traffic (s) / seconds;
+    }
+    if (is_square (s))
+      printf ("Size: %d\t%s: %.3g (%d iter, %.3f seconds)", n, unit, rate, n_iterations, seconds);
+    else
+      printf ("Size: %dx%dx%d\t%s: %.3g (%d iter, %.3f seconds)", m, n, k, unit, rate, n_iterations, seconds);
+    if (hz > 0)
+      printf ("\tflop/cycle: %.2f at %.2f GHz", 1.e9 * Gflops_s / hz, 1.e-9 * hz);
+    if (sgemm_error_bound && is_square (s))
+      printf ("\terror bound: %.3g", sgemm_error_bound (n) * FLT_EPSILON);
+    if (prefetch >= 0)
+      printf ("\tno prefetch Gflop/s: %.3g", prefetch_off);
+    double total_seconds = seconds;
 
-      square_sgemm (n, A, B, C);
+    /* Same shape with operands that are not in any cache */
+    if (cold)
+    {
+      /* sets start on a cache line */
+      size_t set = ((size_t)m * k + (size_t)k * n + (size_t)m * n + 15) / 16 * 16;
+      printf ("\tcold Gflop/s: %.3g", time_multiply_cold (s, cold_pool, set, cold_floats / set));
+    }
 
-      /* Benchmark n_iterations runs of square_sgemm */
+    /* Same shape with denormal operands, the penalty with and without flushing */
+    if (denormal)
+    {
+      double flushed, kept = time_denormal (s, &flushed);
+      printf ("\tdenormal Gflop/s: %.3g (flushed: %.3g)", kept, flushed);
+    }
+
+    /* Same calls with every operand on huge pages */
+    if (pages)
+    {
+      print_misses (dtlb_misses (dtlb, s, A, B, C, n_iterations));
+      float* HA = huge + (A - buf);
+      float* HB = huge + (B - buf);
+      float* HC = huge + (C - buf);
+      memcpy (HA, A, (size_t)m * k * sizeof(float));
+      memcpy (HB, B, (size_t)k * n * sizeof(float));
+      memcpy (HC, C, (size_t)m * n * sizeof(float));
+      int huge_iterations;
+      double huge_seconds;
+      printf ("	2M pages Gflop/s: %.3g", time_multiply (s, HA, HB, HC, &huge_iterations, &huge_seconds));
+      print_misses (dtlb_misses (dtlb, s, HA, HB, HC, n_iterations));
+    }
+
+    /* Same number of calls with B packed once up front */
+    if (sgemm_pack_b)
+    {
+      sgemm_packed_t* P = sgemm_pack_b (k, n, B, k);
+      if (P == NULL) die ("failed to pack B");
       seconds = -wall_time();
       for (int it = 0; it < n_iterations; ++it)
-        square_sgemm (n, A, B, C);
+        sgemm_packed (m, m, A, P, m, C);
       seconds += wall_time();
-
-      /*  compute Mflop/s rate */
-      Gflops_s = 2.e-9 * n_iterations * n * n * n / seconds;
+      check_packed (s, P, A, B, C, C + (size_t)nmax*nmax);
+      sgemm_packed_free (P);
+      printf ("\tpacked Gflop/s: %.3g", 2.e-9 * n_iterations * m * n * k / seconds);
     }
-    printf ("Size: %d\tGflop/s: %.3g (%d iter, %.3f seconds)\n", n, Gflops_s, n_iterations, seconds);
+    if (level3)
+      triangular (s, A, B, C, C + (size_t)nmax*nmax);
+    printf ("\n");
+    if (busy_report)
+      report_threads (total_seconds);
 
     /* Ensure that error does not exceed the theoretical error bound. */
 
     /* C := A * B, computed with square_sgemm */
-    memset (C, 0, n * n * sizeof(float));
-    for (int i = 0; i < n * n; ++i)
+    memset (C, 0, m * n * sizeof(float));
+    for (int i = 0; i < m * n; ++i)
     {
       C[i] = initial;
     }
-    square_sgemm (n, A, B, C);
+    multiply (s, A, B, C);
+
+    /* the checks below are written for column-major operands */
+    if (layouts)
+    {
+      float* W = C + (size_t)nmax*nmax;
+      to_column_major (layouts[0], m, k, A, W);
+      to_column_major (layouts[1], k, n, B, W);
+      to_column_major (layouts[2], m, n, C, W);
+    }
 
     /* Do not explicitly check that A and B were unmodified on square_sgemm exit
      *  - if they were, the following will most likely detect it:
      * C := C - A * B, computed with reference_sgemm */
-    reference_sgemm(n, -1., A, B, C);
+    reference_sgemm(m, n, k, -1., A, B, C);
+
+    if (sgemm_error_bound && is_square (s))
+    {
+      /* Normwise check: max|C - A * B| <= f(n) * e_mach * max|A| * max|B| */
+      for (int i = 0; i < n * n; ++i)
+        C[i] -= initial;
+      if (max_abs (C, n * n) > sgemm_error_bound (n) * FLT_EPSILON * max_abs (A, n * n) * max_abs (B, n * n))
+        die("*** FAILURE *** Error in matrix multiply exceeds normwise error bounds.\n" );
+      continue;
+    }
 
     /* A := |A|, B := |B|, C := |C| */
-    absolute_value (A, n * n);
-    absolute_value (B, n * n);
-    absolute_value (C, n * n);
+    absolute_value (A, m * k);
+    absolute_value (B, k * n);
+    absolute_value (C, m * n);
 
-    /* C := |C| - 3 * e_mach * n * |A| * |B|, computed with reference_sgemm */
-    reference_sgemm (n, -3.*FLT_EPSILON*n, A, B, C);
+    /* C := |C| - 3 * e_mach * k * |A| * |B|, computed with reference_sgemm */
+    reference_sgemm (m, n, k, -3.*FLT_EPSILON*k, A, B, C);
 
     /* If any element in C is positive, then something went wrong in square_sgemm */
-    for (int i = 0; i < n * n; ++i)
+    for (int i = 0; i < m * n; ++i)
       if (C[i] > initial)
 	die("*** FAILURE *** Error in matrix multiply exceeds componentwise error bounds.\n" );
   }
 
-  free (buf);
+  if (pages)
+  {
+    page_free (buf, bytes);
+    page_free (huge, bytes);
+    if (dtlb >= 0)
+      close (dtlb);
+  }
+  else
+    free (buf);
+  free (cold_pool);
+  free (sizes);
 
   return 0;
 }
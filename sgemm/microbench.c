@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include <stdlib.h> // For: exit, atof, posix_memalign, EXIT_FAILURE
+#include <stdio.h>  // For: printf, perror
+#include <unistd.h> // For: getopt
+
+#include "sgemm-kernel.h"
+#include "sgemm-timer.h"
+
+/* The pieces of sgemm_blocked timed one at a time on L1-resident data, so
+ * a regression in the micro-kernel can be told apart from one in packing:
+ * the 8x8 kernel over K, packing of A and B panels, and the CC round trip of
+ * edge tiles. Rates are per core cycle against what one core can issue. */
+
+// 128-bit FMAs and bytes of L1 loads plus stores one core can issue per cycle,
+// two FMA pipes and two 16-byte load/store ports as on Kunpeng 920 (TaiShan v110)
+#if !defined(PEAK_FMA_PER_CYCLE)
+#define PEAK_FMA_PER_CYCLE 2
+#endif
+#if !defined(PEAK_L1_BYTES_PER_CYCLE)
+#define PEAK_L1_BYTES_PER_CYCLE 32
+#endif
+
+// every measurement repeats its calls for at least this long
+#define MIN_SECONDS 0.05
+
+// leading dimension of the matrices panels are packed from, not a power of two
+#define LD 520
+
+static double ghz = 0;
+
+static void die(const char *message)
+{
+  perror(message);
+  exit(EXIT_FAILURE);
+}
+
+static float *alloc_floats(size_t n)
+{
+  float *p;
+  if (posix_memalign((void **)&p, 64, n * sizeof(float)))
+    die("failed to allocate buffer");
+  for (size_t i = 0; i < n; i++)
+    p[i] = (float)rand() / RAND_MAX;
+  return p;
+}
+
+// cycles per call of the statement, repeated until MIN_SECONDS have passed
+#define CYCLES_PER_CALL(result, statement)                        \
+  do                                                              \
+  {                                                               \
+    long calls = 0;                                               \
+    statement;                                                    \
+    double seconds = -timer_seconds();                            \
+    for (long chunk = 64; seconds + timer_seconds() < MIN_SECONDS; chunk *= 2) \
+    {                                                             \
+      for (long it = 0; it < chunk; it++)                         \
+      {                                                           \
+        statement;                                                \
+        /* repeated calls must not be merged */                   \
+        __asm__ volatile("" : : : "memory");                      \
+      }                                                           \
+      calls += chunk;                                             \
+    }                                                             \
+    seconds += timer_seconds();                                   \
+    result = seconds * ghz * 1.e9 / calls;                        \
+  } while (0)
+
+static int sizes[] = {8, 16, 32, 64, 96, 128, 256};
+#define NSIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+
+static void kernel()
+{
+  printf("8x8 kernel, packed panels in L1 (limit %.2f cycles per FMA)\n", 1. / PEAK_FMA_PER_CYCLE);
+  printf("\tK\tcycles/call\tcycles/FMA\tof peak\n");
+  for (int s = 0; s < NSIZES; s++)
+  {
+    int K = sizes[s];
+    float *AA = alloc_floats(SMALL_BLOCK_SIZE * K);
+    float *BB = alloc_floats(K * SMALL_BLOCK_SIZE);
+    float *C = alloc_floats(SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE);
+    double cycles;
+    CYCLES_PER_CALL(cycles, do_block_small(K, SMALL_BLOCK_SIZE, AA, SMALL_BLOCK_SIZE, BB, SMALL_BLOCK_SIZE, C));
+    // 16 128-bit FMAs per k
+    double per_fma = cycles / (16. * K);
+    printf("\t%d\t%.1f\t%.3f\t%.1f%%\n", K, cycles, per_fma, 100. / (per_fma * PEAK_FMA_PER_CYCLE));
+    free(AA);
+    free(BB);
+    free(C);
+  }
+}
+
+static void packing()
+{
+  printf("\npacking of one 8-wide panel from a matrix with leading dimension %d (limit %d bytes per cycle)\n", LD, PEAK_L1_BYTES_PER_CYCLE);
+  printf("\tK\tA cycles\tA bytes/cycle\tB cycles\tB bytes/cycle\n");
+  float *X = alloc_floats((size_t)LD * 256);
+  float *P = alloc_floats(256 * SMALL_BLOCK_SIZE);
+  for (int s = 0; s < NSIZES; s++)
+  {
+    int K = sizes[s];
+    // 8 floats of each of the K columns (A) or rows (B) read, and written
+    double bytes = 2. * sizeof(float) * SMALL_BLOCK_SIZE * K;
+    double a, b;
+    CYCLES_PER_CALL(a, pack_a(K, SMALL_BLOCK_SIZE, LD, X, P));
+    CYCLES_PER_CALL(b, pack_b(K, SMALL_BLOCK_SIZE, LD, X, P));
+    printf("\t%d\t%.1f\t%.2f\t%.1f\t%.2f\n", K, a, bytes / a, b, bytes / b);
+  }
+  free(X);
+  free(P);
+}
+
+static void edge()
+{
+  int K = BLOCK_SIZE;
+  printf("\nedge tiles, K = %d: a full tile runs the kernel on C in place, a cut one goes through CC\n", K);
+  printf("\ttile\tcycles/call\tover full\n");
+  float *AA = alloc_floats(SMALL_BLOCK_SIZE * K);
+  float *BB = alloc_floats(K * SMALL_BLOCK_SIZE);
+  float *C = alloc_floats(LD * SMALL_BLOCK_SIZE);
+  int edges[][2] = {{8, 8}, {7, 8}, {8, 7}, {7, 7}, {1, 1}};
+  double full = 0;
+  for (int e = 0; e < 5; e++)
+  {
+    int MM = edges[e][0], NN = edges[e][1];
+    double cycles;
+    CYCLES_PER_CALL(cycles, do_block_edge(MM, NN, K, AA, BB, LD, C));
+    if (e == 0)
+      full = cycles;
+    printf("\t%dx%d\t%.1f\t%+.1f\n", MM, NN, cycles, cycles - full);
+  }
+  free(AA);
+  free(BB);
+  free(C);
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [-f GHz]\n", prog);
+  fprintf(stderr, "  -f  core clock, measured with a loop of dependent decrements when not given\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "f:")) != -1)
+  {
+    if (opt == 'f')
+      ghz = atof(optarg);
+    else
+      usage(argv[0]);
+  }
+  if (ghz <= 0)
+    ghz = 1.e-9 * core_hz(200000000);
+  if (ghz <= 0)
+  {
+    fprintf(stderr, "cannot measure the clock on this target, give it with -f\n");
+    return EXIT_FAILURE;
+  }
+  printf("core clock: %.2f GHz\n\n", ghz);
+
+  kernel();
+  packing();
+  edge();
+  return 0;
+}
@@ -1,5 +1,6 @@
 import glob
 import statistics
+import sys
 from matplotlib import pyplot as plt
 
 res = []
@@ -17,7 +18,9 @@ def get_data(name):
 
 	return sizes, perfs
 
-blas_sizes, blas_perfs = get_data('benchmark-blas')
+# compare every log against BLAS, or another variant: python3 plot.py benchmark-blocked
+reference = sys.argv[1] if len(sys.argv) > 1 else 'benchmark-blas'
+blas_sizes, blas_perfs = get_data(reference)
 
 for file in glob.glob('*.log'):
 	name = file[:-4]
@@ -27,7 +30,7 @@ for file in glob.glob('*.log'):
 	plt.title(name)
 	plt.xlabel('Matrix Size')
 	plt.ylabel('Performance (GFlops)')
-	plt.plot(blas_sizes, blas_perfs, '-bo', label='blas')
+	plt.plot(blas_sizes, blas_perfs, '-bo', label=reference[len('benchmark-'):])
 	plt.plot(sizes, perfs, '-rx', label=name)
 	plt.legend()
 	plt.savefig(f'{name}.png')
\ No newline at end of file
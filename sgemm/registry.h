@@ -0,0 +1,21 @@
+// every variant linked into one binary, benchmark-all
+// registry.c is generated by make from the variants list in the Makefile; each
+// variant object is rewritten to export only its own renamed symbols
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+struct sgemm_variant
+{
+  // file name without sgemm- and .c, e.g. "blocked-strassen"
+  const char *name;
+  // its sgemm_desc, a variable rather than a constant
+  const char **desc;
+  void (*square_sgemm)(int, float *, float *, float *);
+  // normwise error bound of the variants that are not componentwise stable, else NULL
+  double (*error_bound)(int);
+};
+
+extern const struct sgemm_variant sgemm_variants[];
+extern const int sgemm_nvariants;
+
+#endif
@@ -0,0 +1,93 @@
+// page-size aware allocation of large buffers: the operands of the benchmark
+// and the workspaces of the variants (Strassen arena, packed B, NUMA replicas)
+// the including file must define _GNU_SOURCE before any other include
+#ifndef SGEMM_ALLOC_H
+#define SGEMM_ALLOC_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+enum
+{
+  // 4 KiB pages, even when transparent huge pages are enabled system-wide
+  PAGES_SMALL,
+  // 2 MiB aligned and madvise(MADV_HUGEPAGE), the kernel backs it with huge pages if it can
+  PAGES_THP,
+  // MAP_HUGETLB from the reserved pool (vm.nr_hugepages), falls back to PAGES_THP
+  PAGES_HUGETLB,
+};
+
+// SGEMM_HUGEPAGES=4k, thp or hugetlb picks the pages of the workspaces, thp by default
+static int page_policy()
+{
+  const char *env = getenv("SGEMM_HUGEPAGES");
+  if (env && (strcmp(env, "4k") == 0 || strcmp(env, "0") == 0))
+    return PAGES_SMALL;
+  if (env && strcmp(env, "hugetlb") == 0)
+    return PAGES_HUGETLB;
+  return PAGES_THP;
+}
+
+// mappings are always whole huge pages long, so page_free needs only the size
+// asked for, whatever policy served it; the pages are untouched and land on
+// the node of their first writer, like any fresh anonymous memory
+static size_t page_length(size_t bytes)
+{
+  return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+// NULL when out of memory
+static void *page_alloc(size_t bytes, int policy)
+{
+  size_t length = page_length(bytes);
+  if (policy == PAGES_HUGETLB)
+  {
+    void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+      return p;
+    policy = PAGES_THP;
+  }
+
+  // over-map by one huge page and trim both ends to get a 2 MiB aligned range
+  char *base = (char *)mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED)
+    return NULL;
+  char *p = (char *)(((size_t)base + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+  if (p > base)
+    munmap(base, p - base);
+  if (p + length < base + length + HUGE_PAGE_SIZE)
+    munmap(p + length, base + length + HUGE_PAGE_SIZE - (p + length));
+
+  // only a hint: without THP support this is plain 4 KiB memory
+  madvise(p, length, policy == PAGES_THP ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+  return p;
+}
+
+static void page_free(void *p, size_t bytes)
+{
+  if (p)
+    munmap(p, page_length(bytes));
+}
+
+// a buffer below one huge page is not worth a mapping of its own: it comes
+// from the heap, 64-byte aligned; buffer_free tells the two apart by the size
+static inline void *buffer_alloc(size_t bytes, int policy)
+{
+  if (bytes >= HUGE_PAGE_SIZE)
+    return page_alloc(bytes, policy);
+  void *p;
+  return posix_memalign(&p, 64, bytes ? bytes : 1) ? NULL : p;
+}
+
+static inline void buffer_free(void *p, size_t bytes)
+{
+  if (bytes >= HUGE_PAGE_SIZE)
+    page_free(p, bytes);
+  else
+    free(p);
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include <stdio.h>  // For: fprintf
+#include <stdlib.h> // For: abort
+#include <math.h>   // For: fabsf
+
+// the shared blocking drives our kernel instead of the intrinsic one
+static void do_block_asm(int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C);
+#if defined(VALIDATE_KERNEL)
+static void do_block_checked(int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C);
+#define DO_BLOCK_SMALL do_block_checked
+#else
+#define DO_BLOCK_SMALL do_block_asm
+#endif
+
+#include "sgemm-kernel.h"
+#include "sgemm.h"
+
+#if defined(__aarch64__)
+const char *sgemm_desc = "Blocked sgemm with a software-pipelined AArch64 assembly micro-kernel.";
+#elif defined(__x86_64__) && defined(__AVX2__) && defined(__FMA__)
+const char *sgemm_desc = "Blocked sgemm with a software-pipelined AVX2 assembly micro-kernel.";
+#else
+const char *sgemm_desc = "Blocked sgemm (no assembly micro-kernel for this target, using intrinsics).";
+#endif
+
+void sgemm_set_prefetch(int distance)
+{
+  set_prefetch_distance(distance);
+}
+
+#if defined(__aarch64__)
+
+// same register tile as do_block_small: column j of C is v(16+2j) (rows 0-3)
+// and v(17+2j) (rows 4-7); rows of A and B rotate between two register sets,
+// v0, v1, v4, v5 and v2, v3, v6, v7, so the loads of step k+1 go into one set
+// while the FMAs of step k read the other
+#define FMLA(acc, a, b, lane) "fmla " acc ".4s, " a ".4s, " b ".s[" lane "]\n\t"
+
+// columns 0-3 with B[k, 0-3] in b, columns 4-7 with B[k, 4-7] in b
+#define COMPUTE_LO(a0, a4, b)                                                  \
+  FMLA("v16", a0, b, "0") FMLA("v17", a4, b, "0") FMLA("v18", a0, b, "1")      \
+  FMLA("v19", a4, b, "1") FMLA("v20", a0, b, "2") FMLA("v21", a4, b, "2")      \
+  FMLA("v22", a0, b, "3") FMLA("v23", a4, b, "3")
+#define COMPUTE_HI(a0, a4, b)                                                  \
+  FMLA("v24", a0, b, "0") FMLA("v25", a4, b, "0") FMLA("v26", a0, b, "1")      \
+  FMLA("v27", a4, b, "1") FMLA("v28", a0, b, "2") FMLA("v29", a4, b, "2")      \
+  FMLA("v30", a0, b, "3") FMLA("v31", a4, b, "3")
+
+// one step of k: load the next A row, half the FMAs, load the next B row, the other half
+#define STEP(a0, a4, b0, b4, nextA, nextB)       \
+  "ld1 {" nextA "}, [%[A]], #32\n\t"             \
+  COMPUTE_LO(a0, a4, b0)                         \
+  "ld1 {" nextB "}, [%[B]], #32\n\t"             \
+  COMPUTE_HI(a0, a4, b4)
+
+#define C_COLUMNS(op)                                  \
+  "mov %[p], %[C]\n\t"                                 \
+  op " {v16.4s, v17.4s}, [%[p]], %[ldc]\n\t"           \
+  op " {v18.4s, v19.4s}, [%[p]], %[ldc]\n\t"           \
+  op " {v20.4s, v21.4s}, [%[p]], %[ldc]\n\t"           \
+  op " {v22.4s, v23.4s}, [%[p]], %[ldc]\n\t"           \
+  op " {v24.4s, v25.4s}, [%[p]], %[ldc]\n\t"           \
+  op " {v26.4s, v27.4s}, [%[p]], %[ldc]\n\t"           \
+  op " {v28.4s, v29.4s}, [%[p]], %[ldc]\n\t"           \
+  op " {v30.4s, v31.4s}, [%[p]], %[ldc]\n\t"
+
+// A and B are packed panels with a row stride of SMALL_BLOCK_SIZE
+static void do_block_asm(int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C)
+{
+  long k = K;
+  float *p;
+  __asm__ volatile(
+      C_COLUMNS("ld1")
+      "cbz %[k], 3f\n\t"
+      // step 0 is loaded ahead, k counts the steps still to be loaded
+      "ld1 {v0.4s, v1.4s}, [%[A]], #32\n\t"
+      "ld1 {v4.4s, v5.4s}, [%[B]], #32\n\t"
+      "sub %[k], %[k], #1\n\t"
+      // unrolled 4x, the set holding step k+4 is the one we started with
+      "1:\n\t"
+      "cmp %[k], #4\n\t"
+      "b.lt 2f\n\t"
+      STEP("v0", "v1", "v4", "v5", "v2.4s, v3.4s", "v6.4s, v7.4s")
+      STEP("v2", "v3", "v6", "v7", "v0.4s, v1.4s", "v4.4s, v5.4s")
+      STEP("v0", "v1", "v4", "v5", "v2.4s, v3.4s", "v6.4s, v7.4s")
+      STEP("v2", "v3", "v6", "v7", "v0.4s, v1.4s", "v4.4s, v5.4s")
+      "sub %[k], %[k], #4\n\t"
+      "b 1b\n\t"
+      // remaining steps one at a time, never loading past the panel
+      "2:\n\t"
+      "cbz %[k], 4f\n\t"
+      COMPUTE_LO("v0", "v1", "v4")
+      COMPUTE_HI("v0", "v1", "v5")
+      "ld1 {v0.4s, v1.4s}, [%[A]], #32\n\t"
+      "ld1 {v4.4s, v5.4s}, [%[B]], #32\n\t"
+      "sub %[k], %[k], #1\n\t"
+      "b 2b\n\t"
+      "4:\n\t"
+      COMPUTE_LO("v0", "v1", "v4")
+      COMPUTE_HI("v0", "v1", "v5")
+      "3:\n\t"
+      C_COLUMNS("st1")
+      : [A] "+r"(A), [B] "+r"(B), [k] "+r"(k), [p] "=&r"(p)
+      : [C] "r"(C), [ldc] "r"((long)ldc * sizeof(float))
+      : "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7",
+        "v16", "v17", "v18", "v19", "v20", "v21", "v22", "v23",
+        "v24", "v25", "v26", "v27", "v28", "v29", "v30", "v31",
+        "cc", "memory");
+}
+
+#elif defined(__x86_64__) && defined(__AVX2__) && defined(__FMA__)
+
+// a 256-bit register holds a whole column of the 8x8 tile: column j of C is
+// ymm j, the row of A rotates between ymm8 and ymm9 so the load of step k+1
+// overlaps the FMAs of step k, and B[k, j] is broadcast into ymm10-15 in turn
+#define BFMA(off, b, acc, a)                              \
+  "vbroadcastss " off "(%[B]), %%" b "\n\t"               \
+  "vfmadd231ps %%" b ", %%" a ", %%" acc "\n\t"
+
+#define COMPUTE(a)                                                             \
+  BFMA("0", "ymm10", "ymm0", a) BFMA("4", "ymm11", "ymm1", a)                  \
+  BFMA("8", "ymm12", "ymm2", a) BFMA("12", "ymm13", "ymm3", a)                 \
+  BFMA("16", "ymm14", "ymm4", a) BFMA("20", "ymm15", "ymm5", a)                \
+  BFMA("24", "ymm10", "ymm6", a) BFMA("28", "ymm11", "ymm7", a)                \
+  "add $32, %[B]\n\t"
+
+#define LOAD_A(a)                     \
+  "vmovups (%[A]), %%" a "\n\t"       \
+  "add $32, %[A]\n\t"
+
+#define STEP(a, next) LOAD_A(next) COMPUTE(a)
+
+#define C_COLUMNS(load)                    \
+  "mov %[C], %[p]\n\t"                     \
+  load("ymm0") load("ymm1") load("ymm2") load("ymm3") \
+  load("ymm4") load("ymm5") load("ymm6") load("ymm7")
+#define LOAD_C(r) "vmovups (%[p]), %%" r "\n\t" "add %[ldc], %[p]\n\t"
+#define STORE_C(r) "vmovups %%" r ", (%[p])\n\t" "add %[ldc], %[p]\n\t"
+
+// A and B are packed panels with a row stride of SMALL_BLOCK_SIZE
+static void do_block_asm(int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C)
+{
+  long k = K;
+  float *p;
+  __asm__ volatile(
+      C_COLUMNS(LOAD_C)
+      "test %[k], %[k]\n\t"
+      "jz 3f\n\t"
+      // step 0 is loaded ahead, k counts the steps still to be loaded
+      LOAD_A("ymm8")
+      "sub $1, %[k]\n\t"
+      // unrolled 4x, ymm8 holds step k+4 at the end
+      "1:\n\t"
+      "cmp $4, %[k]\n\t"
+      "jl 2f\n\t"
+      STEP("ymm8", "ymm9")
+      STEP("ymm9", "ymm8")
+      STEP("ymm8", "ymm9")
+      STEP("ymm9", "ymm8")
+      "sub $4, %[k]\n\t"
+      "jmp 1b\n\t"
+      // remaining steps one at a time, never loading past the panel
+      "2:\n\t"
+      "test %[k], %[k]\n\t"
+      "jz 4f\n\t"
+      COMPUTE("ymm8")
+      LOAD_A("ymm8")
+      "sub $1, %[k]\n\t"
+      "jmp 2b\n\t"
+      "4:\n\t"
+      COMPUTE("ymm8")
+      "3:\n\t"
+      C_COLUMNS(STORE_C)
+      : [A] "+r"(A), [B] "+r"(B), [k] "+r"(k), [p] "=&r"(p)
+      : [C] "r"(C), [ldc] "r"((long)ldc * sizeof(float))
+      : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+        "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+        "cc", "memory");
+}
+
+#else
+
+static void do_block_asm(int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C)
+{
+  do_block_small(K, lda, A, ldb, B, ldc, C);
+}
+
+#endif
+
+#if defined(VALIDATE_KERNEL)
+// build with -DVALIDATE_KERNEL (make benchmark-blocked-asm-check) to compare
+// every call of the assembly kernel against the intrinsic one
+static void do_block_checked(int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C)
+{
+  float ref[SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE];
+  for (int j = 0; j < SMALL_BLOCK_SIZE; j++)
+    for (int i = 0; i < SMALL_BLOCK_SIZE; i++)
+      ref[i + j * SMALL_BLOCK_SIZE] = C[i + j * ldc];
+  do_block_small(K, lda, A, ldb, B, SMALL_BLOCK_SIZE, ref);
+  do_block_asm(K, lda, A, ldb, B, ldc, C);
+
+  for (int j = 0; j < SMALL_BLOCK_SIZE; j++)
+    for (int i = 0; i < SMALL_BLOCK_SIZE; i++)
+    {
+      float x = C[i + j * ldc], r = ref[i + j * SMALL_BLOCK_SIZE];
+      // the two kernels may differ in FMA contraction, not in summation order
+      if (fabsf(x - r) > 1e-5f * (K + 1) * (1 + fabsf(r)))
+      {
+        fprintf(stderr, "assembly kernel mismatch at (%d, %d), K = %d: %g vs %g\n", i, j, K, x, r);
+        abort();
+      }
+    }
+}
+#endif
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A, B, and C are lda-by-lda matrices stored in column-major format.
+ * On exit, A and B maintain their input values. */
+void square_sgemm(int lda, float *restrict A, float *restrict B, float *restrict C)
+{
+  sgemm_blocked(lda, lda, lda, lda, A, lda, B, lda, C);
+}
+
+void sgemm_rect(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  sgemm_blocked(M, N, K, lda, A, ldb, B, ldc, C);
+}
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+
+#include "sgemm-alloc.h"
+#include "sgemm-kernel.h"
+#include "sgemm-pool.h"
+#include "sgemm.h"
+
+const char *sgemm_desc = "NUMA-aware parallel blocked sgemm.";
+
+void sgemm_set_prefetch(int distance)
+{
+  set_prefetch_distance(distance);
+}
+
+int sgemm_set_threads(int nthreads, const char *affinity)
+{
+  return pool_set_threads(nthreads, affinity);
+}
+
+void sgemm_set_denormals(int mode)
+{
+  set_denormal_mode(mode);
+}
+
+// below this many multiply-adds one thread does the whole product
+#if !defined(PARALLEL_THRESHOLD)
+#define PARALLEL_THRESHOLD (128 * 128 * 128)
+#endif
+
+// per node: replica of the packed B block-row being multiplied,
+// placed on the node by the first touch of its own packing threads
+static float *replica[MAX_NODES];
+static size_t replica_size[MAX_NODES];
+static pthread_barrier_t node_barrier[MAX_NODES];
+static int node_barrier_count = 0;
+// pool generation the barriers were made for
+static int node_barrier_generation = 0;
+
+struct job
+{
+  int M, N, K;
+  int lda, ldb, ldc;
+  float *A, *B, *C;
+};
+
+static void numa_worker(void *arg, int tid)
+{
+  struct job *job = (struct job *)arg;
+  int node = pool.node[tid];
+  int rank = pool.rank[tid];
+  int nt = pool.node_threads[node];
+  float *BP = replica[node];
+
+  // threads of a node are numbered contiguously, so splitting the 8-row
+  // tiles of A in thread order also hands each node one contiguous row-block
+  int tiles = (job->M + SMALL_BLOCK_SIZE - 1) / SMALL_BLOCK_SIZE;
+  int i0 = min(job->M, (int)((long)tiles * tid / pool.nthreads) * SMALL_BLOCK_SIZE);
+  int i1 = min(job->M, (int)((long)tiles * (tid + 1) / pool.nthreads) * SMALL_BLOCK_SIZE);
+
+  /* For each block-row of B */
+  for (int p = 0; p < job->K; p += BLOCK_SIZE)
+  {
+    int KK = min(BLOCK_SIZE, job->K - p);
+
+    // threads of this node pack their share of the panels into the node's replica
+    for (int j = rank * SMALL_BLOCK_SIZE; j < job->N; j += nt * SMALL_BLOCK_SIZE)
+    {
+      int NN = min(SMALL_BLOCK_SIZE, job->N - j);
+      pack_b(KK, NN, job->ldb, job->B + p + j * job->ldb, BP + j * KK);
+    }
+    pthread_barrier_wait(&node_barrier[node]);
+
+    /* For each block-row of my rows of A */
+    for (int i = i0; i < i1; i += BLOCK_SIZE)
+    {
+      int MM = min(BLOCK_SIZE, i1 - i);
+      do_block_prepacked(MM, job->N, KK, job->lda, job->A + i + p * job->lda, BP, job->ldc, job->C + i);
+    }
+    // replica is repacked for the next block-row
+    pthread_barrier_wait(&node_barrier[node]);
+  }
+}
+
+// skinny products have no block-row of B worth replicating: every thread runs
+// the streaming kernels of sgemm_blocked on its own rows of A and C, or on its
+// own columns of B and C when A is the skinny operand
+static void skinny_worker(void *arg, int tid)
+{
+  struct job *job = (struct job *)arg;
+  if (job->N <= SKINNY_MAX)
+  {
+    int rows = 4 * SKINNY_V;
+    int strips = (job->M + rows - 1) / rows;
+    int i0 = min(job->M, (int)((long)strips * tid / pool.nthreads) * rows);
+    int i1 = min(job->M, (int)((long)strips * (tid + 1) / pool.nthreads) * rows);
+    if (i0 < i1)
+      sgemm_blocked(i1 - i0, job->N, job->K, job->lda, job->A + i0, job->ldb, job->B, job->ldc, job->C + i0);
+  }
+  else
+  {
+    int panels = (job->N + SMALL_BLOCK_SIZE - 1) / SMALL_BLOCK_SIZE;
+    int j0 = min(job->N, (int)((long)panels * tid / pool.nthreads) * SMALL_BLOCK_SIZE);
+    int j1 = min(job->N, (int)((long)panels * (tid + 1) / pool.nthreads) * SMALL_BLOCK_SIZE);
+    if (j0 < j1)
+      sgemm_blocked(job->M, j1 - j0, job->K, job->lda, job->A, job->ldb, job->B + j0 * job->ldb, job->ldc, job->C + j0 * job->ldc);
+  }
+}
+
+// make sure every node has room for a BLOCK_SIZE x N block-row of packed B
+// the pages are untouched, so they land where they are first written
+static int reserve_replicas(int N)
+{
+  size_t NP = (N + SMALL_BLOCK_SIZE - 1) / SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE;
+  size_t size = sizeof(float) * BLOCK_SIZE * NP;
+  for (int node = 0; node < pool.nnodes; node++)
+  {
+    if (replica_size[node] >= size)
+      continue;
+    page_free(replica[node], replica_size[node]);
+    replica_size[node] = 0;
+    replica[node] = (float *)page_alloc(size, page_policy());
+    if (replica[node] == NULL)
+      return 0;
+    replica_size[node] = size;
+  }
+  return 1;
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A is M-by-K, B is K-by-N and C is M-by-N, stored in column-major format
+ * with leading dimensions lda, ldb and ldc, using the whole thread pool. */
+static void parallel_sgemm(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  if ((long)M * N * K < PARALLEL_THRESHOLD)
+  {
+    sgemm_blocked(M, N, K, lda, A, ldb, B, ldc, C);
+    return;
+  }
+
+  if (pool.nthreads == 0)
+    pool_init();
+  if (node_barrier_generation != pool.generation)
+  {
+    for (int node = 0; node < node_barrier_count; node++)
+      pthread_barrier_destroy(&node_barrier[node]);
+    for (int node = 0; node < pool.nnodes; node++)
+      pthread_barrier_init(&node_barrier[node], NULL, pool.node_threads[node]);
+    node_barrier_count = pool.nnodes;
+    node_barrier_generation = pool.generation;
+  }
+
+  struct job job = {M, N, K, lda, ldb, ldc, A, B, C};
+  if (pool.nthreads > 1 && (N <= SKINNY_MAX || M <= SKINNY_MAX))
+  {
+    pool_run(skinny_worker, &job);
+    return;
+  }
+  if (pool.nthreads == 1 || !reserve_replicas(N))
+  {
+    sgemm_blocked(M, N, K, lda, A, ldb, B, ldc, C);
+    return;
+  }
+
+  pool_run(numa_worker, &job);
+}
+
+// the pool threads take the denormal mode from the caller's control register
+void sgemm_rect(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  uint64_t saved = denormals_enter();
+  parallel_sgemm(M, N, K, lda, A, ldb, B, ldc, C);
+  denormals_leave(saved);
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A, B, and C are lda-by-lda matrices stored in column-major format.
+ * On exit, A and B maintain their input values. */
+void square_sgemm(int lda, float *restrict A, float *restrict B, float *restrict C)
+{
+  sgemm_rect(lda, lda, lda, lda, A, lda, B, lda, C);
+}
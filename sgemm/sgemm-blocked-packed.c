@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+#include <pthread.h> // For: pthread_key_create, pthread_once
+#include <stdlib.h>  // For: malloc, free
+
+#include "sgemm-alloc.h"
+#include "sgemm-kernel.h"
+#include "sgemm.h"
+
+const char *sgemm_desc = "Blocked sgemm with B packed ahead of time.";
+
+void sgemm_set_prefetch(int distance)
+{
+  set_prefetch_distance(distance);
+}
+
+struct sgemm_packed
+{
+  int K, N;
+  // N rounded up to SMALL_BLOCK_SIZE
+  int NP;
+  // K-block p starts at data + p * NP, panel j of it at + j * KK
+  float *data;
+};
+
+// the packed B of square_sgemm, kept between calls so they do not allocate
+static __thread sgemm_packed_t scratch;
+static __thread size_t scratch_size;
+// hands the scratch of an exiting thread back
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+// a thread with a scratch exits, its thread-local variables still readable
+static void release_scratch(void *p)
+{
+  buffer_free(p, scratch_size);
+  scratch.data = NULL;
+  scratch_size = 0;
+}
+
+static void create_scratch_key()
+{
+  pthread_key_create(&scratch_key, release_scratch);
+}
+
+static int padded(int N)
+{
+  return (N + SMALL_BLOCK_SIZE - 1) / SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE;
+}
+
+// P->data holds at least K * padded(N) floats
+static void pack_into(int K, int N, const float *B, int ldb, sgemm_packed_t *P)
+{
+  P->K = K;
+  P->N = N;
+  P->NP = padded(N);
+
+  /* For each block-row of B */
+  for (int p = 0; p < K; p += BLOCK_SIZE)
+  {
+    int KK = min(BLOCK_SIZE, K - p);
+    /* For each block-column of B */
+    for (int j = 0; j < N; j += SMALL_BLOCK_SIZE)
+    {
+      int NN = min(SMALL_BLOCK_SIZE, N - j);
+      pack_b(KK, NN, ldb, B + p + j * ldb, P->data + (size_t)p * P->NP + j * KK);
+    }
+  }
+}
+
+// small handles come from the heap, only large ones get huge pages
+sgemm_packed_t *sgemm_pack_b(int K, int N, const float *B, int ldb)
+{
+  sgemm_packed_t *P = (sgemm_packed_t *)malloc(sizeof(sgemm_packed_t));
+  if (P == NULL)
+    return NULL;
+  P->data = (float *)buffer_alloc(sizeof(float) * K * padded(N), page_policy());
+  if (P->data == NULL)
+  {
+    free(P);
+    return NULL;
+  }
+  pack_into(K, N, B, ldb, P);
+  return P;
+}
+
+void sgemm_packed(int M, int lda, float *A, const sgemm_packed_t *B, int ldc, float *C)
+{
+  /* For each block-row of A */
+  for (int i = 0; i < M; i += BLOCK_SIZE)
+  {
+    int MM = min(BLOCK_SIZE, M - i);
+    /* For each block-column of A */
+    for (int p = 0; p < B->K; p += BLOCK_SIZE)
+    {
+      int KK = min(BLOCK_SIZE, B->K - p);
+
+      do_block_prepacked(MM, B->N, KK, lda, A + i + p * lda, B->data + (size_t)p * B->NP, ldc, C + i);
+    }
+  }
+}
+
+void sgemm_packed_free(sgemm_packed_t *B)
+{
+  if (B == NULL)
+    return;
+  buffer_free(B->data, sizeof(float) * B->K * B->NP);
+  free(B);
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A, B, and C are lda-by-lda matrices stored in column-major format.
+ * On exit, A and B maintain their input values.
+ * Packs B on every call; the benchmark times the steady state separately. */
+void square_sgemm(int lda, float *restrict A, float *restrict B, float *restrict C)
+{
+  size_t size = sizeof(float) * lda * padded(lda);
+  if (size > scratch_size)
+  {
+    buffer_free(scratch.data, scratch_size);
+    scratch_size = 0;
+    scratch.data = (float *)buffer_alloc(size, page_policy());
+    pthread_once(&scratch_once, create_scratch_key);
+    pthread_setspecific(scratch_key, scratch.data);
+    if (scratch.data == NULL)
+    {
+      sgemm_blocked(lda, lda, lda, lda, A, lda, B, lda, C);
+      return;
+    }
+    scratch_size = size;
+  }
+  pack_into(lda, lda, B, lda, &scratch);
+  sgemm_packed(lda, lda, A, &scratch, lda, C);
+}
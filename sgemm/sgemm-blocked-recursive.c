@@ -0,0 +1,72 @@
+#include "sgemm-kernel.h"
+#include "sgemm.h"
+
+const char *sgemm_desc = "Cache-oblivious recursive sgemm on the blocked kernel.";
+
+void sgemm_set_prefetch(int distance)
+{
+  set_prefetch_distance(distance);
+}
+
+// largest leaf in every dimension, handed to do_block_large
+#if !defined(RECURSIVE_LEAF)
+#define RECURSIVE_LEAF BLOCK_SIZE
+#endif
+
+#if RECURSIVE_LEAF > BLOCK_SIZE
+#error "RECURSIVE_LEAF must not exceed BLOCK_SIZE, the packing buffers of do_block_large"
+#endif
+
+// split point near the middle, on a multiple of the 8x8 tile
+static int half(int n)
+{
+  return (n / 2 + SMALL_BLOCK_SIZE - 1) / SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE;
+}
+
+// halve the largest of M, N and K until the whole problem is a leaf: each
+// level of the recursion shrinks the working set by about half, so some level
+// fits every cache, whatever its size, without a tuned block size per level
+static void sgemm_recursive(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  if (M <= RECURSIVE_LEAF && N <= RECURSIVE_LEAF && K <= RECURSIVE_LEAF)
+  {
+    do_block_large(M, N, K, lda, A, ldb, B, ldc, C);
+    return;
+  }
+
+  if (M >= N && M >= K)
+  {
+    // C1 := C1 + A1 * B, C2 := C2 + A2 * B
+    int M1 = half(M);
+    sgemm_recursive(M1, N, K, lda, A, ldb, B, ldc, C);
+    sgemm_recursive(M - M1, N, K, lda, A + M1, ldb, B, ldc, C + M1);
+  }
+  else if (N >= K)
+  {
+    // C1 := C1 + A * B1, C2 := C2 + A * B2
+    int N1 = half(N);
+    sgemm_recursive(M, N1, K, lda, A, ldb, B, ldc, C);
+    sgemm_recursive(M, N - N1, K, lda, A, ldb, B + N1 * ldb, ldc, C + N1 * ldc);
+  }
+  else
+  {
+    // C := C + A1 * B1 + A2 * B2
+    int K1 = half(K);
+    sgemm_recursive(M, N, K1, lda, A, ldb, B, ldc, C);
+    sgemm_recursive(M, N, K - K1, lda, A + K1 * lda, ldb, B + K1, ldc, C);
+  }
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A, B, and C are lda-by-lda matrices stored in column-major format.
+ * On exit, A and B maintain their input values. */
+void square_sgemm(int lda, float *restrict A, float *restrict B, float *restrict C)
+{
+  sgemm_recursive(lda, lda, lda, lda, A, lda, B, lda, C);
+}
+
+void sgemm_rect(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  sgemm_recursive(M, N, K, lda, A, ldb, B, ldc, C);
+}
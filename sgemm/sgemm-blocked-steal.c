@@ -0,0 +1,210 @@
+#define _GNU_SOURCE
+#include <time.h> // For: clock_gettime, CLOCK_MONOTONIC
+
+#include "sgemm-kernel.h"
+#include "sgemm-pool.h"
+#include "sgemm.h"
+
+const char *sgemm_desc = "Parallel blocked sgemm with a work-stealing tile scheduler.";
+
+void sgemm_set_prefetch(int distance)
+{
+  set_prefetch_distance(distance);
+}
+
+int sgemm_set_threads(int nthreads, const char *affinity)
+{
+  return pool_set_threads(nthreads, affinity);
+}
+
+void sgemm_set_denormals(int mode)
+{
+  set_denormal_mode(mode);
+}
+
+// a task is one BLOCK_SIZE x NC_BLOCK tile of C, computed over the whole K
+#if !defined(NC_BLOCK)
+#define NC_BLOCK 256
+#endif
+
+// below this many multiply-adds one thread does the whole product
+#if !defined(PARALLEL_THRESHOLD)
+#define PARALLEL_THRESHOLD (128 * 128 * 128)
+#endif
+
+// tasks are numbered with the row-block fastest, so neighbouring tasks share
+// a column-block of B; every thread starts with a contiguous range of them,
+// runs it from the bottom and thieves take the upper half from the top
+struct deque
+{
+  pthread_spinlock_t lock;
+  int top, bottom;
+} __attribute__((aligned(64)));
+
+struct stats
+{
+  double busy;
+  int tasks, steals;
+} __attribute__((aligned(64)));
+
+static struct deque deques[MAX_THREADS];
+static struct stats stats[MAX_THREADS];
+static int deques_ready = 0;
+
+struct job
+{
+  int M, N, K;
+  int lda, ldb, ldc;
+  float *A, *B, *C;
+  // number of row-blocks and tasks
+  int mt, ntasks;
+};
+
+static double now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return 1. * t.tv_sec + 1.e-9 * t.tv_nsec;
+}
+
+static int pop(struct deque *d, int *task)
+{
+  int found = 0;
+  pthread_spin_lock(&d->lock);
+  if (d->top < d->bottom)
+  {
+    *task = --d->bottom;
+    found = 1;
+  }
+  pthread_spin_unlock(&d->lock);
+  return found;
+}
+
+// take the upper half of some other thread's range into our own deque
+static int steal(int tid)
+{
+  for (int v = 1; v < pool.nthreads; v++)
+  {
+    struct deque *victim = &deques[(tid + v) % pool.nthreads];
+    int top = 0, bottom = 0;
+    pthread_spin_lock(&victim->lock);
+    if (victim->top < victim->bottom)
+    {
+      top = victim->top;
+      bottom = top + (victim->bottom - victim->top + 1) / 2;
+      victim->top = bottom;
+    }
+    pthread_spin_unlock(&victim->lock);
+
+    if (top < bottom)
+    {
+      struct deque *self = &deques[tid];
+      pthread_spin_lock(&self->lock);
+      self->top = top;
+      self->bottom = bottom;
+      pthread_spin_unlock(&self->lock);
+      stats[tid].steals += bottom - top;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void run_task(struct job *job, int task)
+{
+  int i = task % job->mt * BLOCK_SIZE;
+  int j = task / job->mt * NC_BLOCK;
+  int MM = min(BLOCK_SIZE, job->M - i);
+  int NN = min(NC_BLOCK, job->N - j);
+  sgemm_blocked(MM, NN, job->K, job->lda, job->A + i, job->ldb, job->B + j * job->ldb,
+                job->ldc, job->C + i + j * job->ldc);
+}
+
+static void steal_worker(void *arg, int tid)
+{
+  struct job *job = (struct job *)arg;
+  int task;
+  for (;;)
+  {
+    if (pop(&deques[tid], &task))
+    {
+      double t = now();
+      run_task(job, task);
+      stats[tid].busy += now() - t;
+      stats[tid].tasks++;
+    }
+    // no more tasks are ever created, so once nothing can be stolen we are done
+    else if (!steal(tid))
+      break;
+  }
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A is M-by-K, B is K-by-N and C is M-by-N, stored in column-major format
+ * with leading dimensions lda, ldb and ldc. */
+static void parallel_sgemm(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  if ((long)M * N * K < PARALLEL_THRESHOLD)
+  {
+    sgemm_blocked(M, N, K, lda, A, ldb, B, ldc, C);
+    return;
+  }
+
+  if (pool.nthreads == 0)
+    pool_init();
+  // every slot, the pool may be restarted with more threads
+  if (!deques_ready)
+  {
+    for (int t = 0; t < MAX_THREADS; t++)
+      pthread_spin_init(&deques[t].lock, PTHREAD_PROCESS_PRIVATE);
+    deques_ready = 1;
+  }
+
+  struct job job = {M, N, K, lda, ldb, ldc, A, B, C};
+  job.mt = (M + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  job.ntasks = job.mt * ((N + NC_BLOCK - 1) / NC_BLOCK);
+  for (int t = 0; t < pool.nthreads; t++)
+  {
+    deques[t].top = (int)((long)job.ntasks * t / pool.nthreads);
+    deques[t].bottom = (int)((long)job.ntasks * (t + 1) / pool.nthreads);
+  }
+  pool_run(steal_worker, &job);
+}
+
+// the pool threads take the denormal mode from the caller's control register
+void sgemm_rect(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  uint64_t saved = denormals_enter();
+  parallel_sgemm(M, N, K, lda, A, ldb, B, ldc, C);
+  denormals_leave(saved);
+}
+
+int sgemm_thread_stats(int max, double *busy, int *tasks, int *steals)
+{
+  for (int t = 0; t < pool.nthreads && t < max; t++)
+  {
+    busy[t] = stats[t].busy;
+    tasks[t] = stats[t].tasks;
+    steals[t] = stats[t].steals;
+  }
+  return pool.nthreads;
+}
+
+void sgemm_thread_stats_reset()
+{
+  for (int t = 0; t < MAX_THREADS; t++)
+  {
+    stats[t].busy = 0;
+    stats[t].tasks = stats[t].steals = 0;
+  }
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A, B, and C are lda-by-lda matrices stored in column-major format.
+ * On exit, A and B maintain their input values. */
+void square_sgemm(int lda, float *restrict A, float *restrict B, float *restrict C)
+{
+  sgemm_rect(lda, lda, lda, lda, A, lda, B, lda, C);
+}
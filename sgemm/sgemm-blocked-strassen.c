@@ -0,0 +1,250 @@
+#define _GNU_SOURCE
+#include <pthread.h> // For: pthread_key_create, pthread_once
+#include <stdlib.h>  // For: getenv, atoi
+#include <string.h>  // For: memset
+#include <math.h>    // For: pow
+
+#include "sgemm-alloc.h"
+#include "sgemm-kernel.h"
+#include "sgemm.h"
+
+const char *sgemm_desc = "Strassen-Winograd sgemm on top of the blocked kernel (effective Gflop/s, 2n^3 flops).";
+
+void sgemm_set_prefetch(int distance)
+{
+  set_prefetch_distance(distance);
+}
+
+// below this size the classic blocked kernel takes over
+// can be overridden at runtime by SGEMM_STRASSEN_CUTOFF
+#if !defined(STRASSEN_CUTOFF)
+#define STRASSEN_CUTOFF 512
+#endif
+
+static int strassen_cutoff = 0;
+
+// workspace arena: one allocation, used as a stack by the recursion
+// one per thread, so independent calls can run concurrently
+static __thread float *arena = NULL;
+static __thread size_t arena_size = 0;
+static __thread size_t arena_top = 0;
+// hands the arena of an exiting thread back
+static pthread_key_t arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+static int get_cutoff()
+{
+  if (strassen_cutoff == 0)
+  {
+    char *env = getenv("SGEMM_STRASSEN_CUTOFF");
+    strassen_cutoff = env ? atoi(env) : STRASSEN_CUTOFF;
+    // the blocked kernel needs something to chew on
+    if (strassen_cutoff < 2 * SMALL_BLOCK_SIZE)
+      strassen_cutoff = 2 * SMALL_BLOCK_SIZE;
+  }
+  return strassen_cutoff;
+}
+
+// floats of workspace needed to multiply n-by-n matrices
+static size_t workspace_size(int n)
+{
+  if (n <= get_cutoff())
+    return 0;
+  if (n % 2)
+    return workspace_size(n - 1);
+  size_t h = n / 2;
+  // S, T, P and U temporaries of this level
+  return 4 * h * h + workspace_size(n / 2);
+}
+
+// a thread with an arena exits, its thread-local variables still readable
+static void release_arena(void *p)
+{
+  page_free(p, arena_size * sizeof(float));
+  arena = NULL;
+  arena_size = 0;
+}
+
+static void create_arena_key()
+{
+  pthread_key_create(&arena_key, release_arena);
+}
+
+static void reserve_arena(int n)
+{
+  size_t size = workspace_size(n);
+  if (size <= arena_size)
+    return;
+  page_free(arena, arena_size * sizeof(float));
+  arena_size = 0;
+  arena = (float *)page_alloc(size * sizeof(float), page_policy());
+  if (arena)
+    arena_size = size;
+  pthread_once(&arena_once, create_arena_key);
+  pthread_setspecific(arena_key, arena);
+}
+
+// number of halvings before reaching the cutoff
+static int strassen_levels(int n)
+{
+  int levels = 0;
+  while (n > get_cutoff())
+  {
+    n /= 2;
+    levels++;
+  }
+  return levels;
+}
+
+// C := X + Y, all h-by-h
+static void add(int h, int ldx, const float *X, int ldy, const float *Y, int ldc, float *C)
+{
+  for (int j = 0; j < h; j++)
+    for (int i = 0; i < h; i++)
+      C[i + j * ldc] = X[i + j * ldx] + Y[i + j * ldy];
+}
+
+// C := X - Y, all h-by-h
+static void sub(int h, int ldx, const float *X, int ldy, const float *Y, int ldc, float *C)
+{
+  for (int j = 0; j < h; j++)
+    for (int i = 0; i < h; i++)
+      C[i + j * ldc] = X[i + j * ldx] - Y[i + j * ldy];
+}
+
+// C := C + X, all h-by-h
+static void acc(int h, int ldx, const float *X, int ldc, float *C)
+{
+  for (int j = 0; j < h; j++)
+    for (int i = 0; i < h; i++)
+      C[i + j * ldc] += X[i + j * ldx];
+}
+
+/* C := C + A * B for n-by-n column-major operands, using the Winograd variant
+ * of Strassen: 7 half-size products per level instead of 8.
+ *
+ *   S1 = A21 + A22   S2 = S1 - A11   S3 = A11 - A21   S4 = A12 - S2
+ *   T1 = B12 - B11   T2 = B22 - T1   T3 = B22 - B12   T4 = T2 - B21
+ *   P1 = A11 B11  P2 = A12 B21  P3 = S4 B22  P4 = A22 T4
+ *   P5 = S1 T1    P6 = S2 T2    P7 = S3 T3
+ *   C11 += P1 + P2           C12 += P1 + P6 + P5 + P3
+ *   C21 += P1 + P6 + P7 - P4 C22 += P1 + P6 + P7 + P5 */
+static void strassen(int n, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  if (n <= get_cutoff())
+  {
+    sgemm_blocked(n, n, n, lda, A, ldb, B, ldc, C);
+    return;
+  }
+
+  if (n % 2)
+  {
+    // dynamic peeling: leading (n-1)x(n-1) part recursively, last row and column by hand
+    int m = n - 1;
+    strassen(m, lda, A, ldb, B, ldc, C);
+    // C[0:m, 0:m] += A[0:m, m] * B[m, 0:m]
+    for (int j = 0; j < m; j++)
+    {
+      float b = B[m + j * ldb];
+      for (int i = 0; i < m; i++)
+        C[i + j * ldc] += A[i + m * lda] * b;
+    }
+    // C[0:n, m] += A[0:n, 0:n] * B[0:n, m]
+    for (int k = 0; k < n; k++)
+    {
+      float b = B[k + m * ldb];
+      for (int i = 0; i < n; i++)
+        C[i + m * ldc] += A[i + k * lda] * b;
+    }
+    // C[m, 0:m] += A[m, 0:n] * B[0:n, 0:m]
+    for (int j = 0; j < m; j++)
+    {
+      float c = C[m + j * ldc];
+      for (int k = 0; k < n; k++)
+        c += A[m + k * lda] * B[k + j * ldb];
+      C[m + j * ldc] = c;
+    }
+    return;
+  }
+
+  int h = n / 2;
+  float *A11 = A, *A21 = A + h, *A12 = A + h * lda, *A22 = A + h + h * lda;
+  float *B11 = B, *B21 = B + h, *B12 = B + h * ldb, *B22 = B + h + h * ldb;
+  float *C11 = C, *C21 = C + h, *C12 = C + h * ldc, *C22 = C + h + h * ldc;
+
+  // take this level's temporaries from the arena
+  float *S = arena + arena_top;
+  float *T = S + (size_t)h * h;
+  float *P = T + (size_t)h * h;
+  float *U = P + (size_t)h * h;
+  arena_top += 4 * (size_t)h * h;
+
+  // U = P1
+  memset(U, 0, sizeof(float) * h * h);
+  strassen(h, lda, A11, ldb, B11, h, U);
+  acc(h, h, U, ldc, C11);
+  // C11 += P2
+  strassen(h, lda, A12, ldb, B21, ldc, C11);
+
+  // P = P5 = S1 T1
+  add(h, lda, A21, lda, A22, h, S);
+  sub(h, ldb, B12, ldb, B11, h, T);
+  memset(P, 0, sizeof(float) * h * h);
+  strassen(h, h, S, h, T, h, P);
+  acc(h, h, P, ldc, C12);
+  acc(h, h, P, ldc, C22);
+
+  // U = P1 + P6 = P1 + S2 T2
+  sub(h, h, S, lda, A11, h, S);
+  sub(h, ldb, B22, h, T, h, T);
+  strassen(h, h, S, h, T, h, U);
+  acc(h, h, U, ldc, C12);
+  acc(h, h, U, ldc, C21);
+  acc(h, h, U, ldc, C22);
+
+  // C12 += P3 = S4 B22, S4 = A12 - S2
+  sub(h, lda, A12, h, S, h, S);
+  strassen(h, h, S, ldb, B22, ldc, C12);
+
+  // C21 -= P4 = A22 T4, computed as A22 (-T4) with -T4 = B21 - T2
+  sub(h, ldb, B21, h, T, h, T);
+  strassen(h, lda, A22, h, T, ldc, C21);
+
+  // P = P7 = S3 T3
+  sub(h, lda, A11, lda, A21, h, S);
+  sub(h, ldb, B22, ldb, B12, h, T);
+  memset(P, 0, sizeof(float) * h * h);
+  strassen(h, h, S, h, T, h, P);
+  acc(h, h, P, ldc, C21);
+  acc(h, h, P, ldc, C22);
+
+  arena_top -= 4 * (size_t)h * h;
+}
+
+/* Normwise error bound of the Winograd variant (Higham, Accuracy and Stability
+ * of Numerical Algorithms, 2nd ed., Theorem 23.3):
+ *   max|C - fl(C)| <= f(n) * e_mach * max|A| * max|B|
+ * with f(n) = 18^l (n0^2 + 6 n0) - 6n for l levels of recursion above a
+ * classic leaf of size n0. Without recursion this is the classic bound n^2. */
+double sgemm_error_bound(int n)
+{
+  int levels = strassen_levels(n);
+  double n0 = (double)n / (1 << levels);
+  return pow(18, levels) * (n0 * n0 + 6 * n0) - 6. * n;
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A, B, and C are lda-by-lda matrices stored in column-major format.
+ * On exit, A and B maintain their input values. */
+void square_sgemm(int lda, float *restrict A, float *restrict B, float *restrict C)
+{
+  reserve_arena(lda);
+  if (arena_size < workspace_size(lda))
+  {
+    // no workspace, fall back to the classic path
+    sgemm_blocked(lda, lda, lda, lda, A, lda, B, lda, C);
+    return;
+  }
+  strassen(lda, lda, A, lda, B, lda, C);
+}
@@ -0,0 +1,151 @@
+#if !defined(__ARM_FEATURE_SVE)
+#error "sgemm-blocked-sve.c needs a compiler targeting SVE, e.g. make benchmark-blocked-sve OPT='-O3 -march=armv8.2-a+sve'"
+#endif
+#include <arm_sve.h>
+
+#include "sgemm.h"
+
+const char *sgemm_desc = "Blocked sgemm with a vector-length-agnostic SVE micro-kernel.";
+
+#if !defined(BLOCK_SIZE)
+#define BLOCK_SIZE 96
+#endif
+
+// columns of the register tile; its height is two vectors, 2 * svcntw() rows
+#define SMALL_BLOCK_SIZE 8
+
+// tallest register tile, for 2048-bit vectors
+#define MAX_SMALL_BLOCK_ROWS (2 * 2048 / 32)
+
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+// the 16 accumulators of the NEON kernel, two vectors per column of C,
+// whatever the vector length: 8x8 at 128 bits, 16x8 at 256, 32x8 at 512
+// SVE vectors are sizeless and cannot live in arrays, hence the macros
+#define LOAD_C(j)                                      \
+  svbool_t q0##j = j < NN ? p0 : svpfalse_b();         \
+  svbool_t q1##j = j < NN ? p1 : svpfalse_b();         \
+  svfloat32_t c0##j = svld1_f32(q0##j, C + j * ldc);   \
+  svfloat32_t c1##j = svld1_f32(q1##j, C + vl + j * ldc);
+
+#define STORE_C(j)                        \
+  svst1_f32(q0##j, C + j * ldc, c0##j);   \
+  svst1_f32(q1##j, C + vl + j * ldc, c1##j);
+
+#define FMA_C(j, b, lane)                     \
+  c0##j = svmla_lane_f32(c0##j, a0, b, lane); \
+  c1##j = svmla_lane_f32(c1##j, a1, b, lane);
+
+// C: MM x NN with MM <= 2 * svcntw(), NN <= SMALL_BLOCK_SIZE
+// AA: (2 * svcntw()) x K packed by pack_a, BB: K x SMALL_BLOCK_SIZE packed by pack_b
+// edges are handled with predicated loads and stores, no scratch copy of C
+static void do_block_small(int K, int MM, int NN, const float *restrict AA, const float *restrict BB, int ldc, float *restrict C)
+{
+  int vl = svcntw();
+  svbool_t all = svptrue_b32();
+  // rows of C held by the first and the second vector
+  svbool_t p0 = svwhilelt_b32_s32(0, MM);
+  svbool_t p1 = svwhilelt_b32_s32(vl, MM);
+
+  LOAD_C(0) LOAD_C(1) LOAD_C(2) LOAD_C(3) LOAD_C(4) LOAD_C(5) LOAD_C(6) LOAD_C(7)
+
+#pragma GCC unroll 8
+  for (int k = 0; k < K; ++k)
+  {
+    svfloat32_t a0 = svld1_f32(all, AA + k * 2 * vl);
+    svfloat32_t a1 = svld1_f32(all, AA + k * 2 * vl + vl);
+
+    // every 128-bit segment gets B[k, 0-3] (resp. 4-7), picked by lane like the NEON kernel
+    svfloat32_t B0 = svld1rq_f32(all, BB + k * SMALL_BLOCK_SIZE);
+    FMA_C(0, B0, 0) FMA_C(1, B0, 1) FMA_C(2, B0, 2) FMA_C(3, B0, 3)
+
+    svfloat32_t B4 = svld1rq_f32(all, BB + k * SMALL_BLOCK_SIZE + 4);
+    FMA_C(4, B4, 0) FMA_C(5, B4, 1) FMA_C(6, B4, 2) FMA_C(7, B4, 3)
+  }
+
+  STORE_C(0) STORE_C(1) STORE_C(2) STORE_C(3) STORE_C(4) STORE_C(5) STORE_C(6) STORE_C(7)
+}
+
+// pack MM x K panel of A into AA, 2 * svcntw() rows per k
+// the zeroing predicated loads pad rows beyond MM
+static void pack_a(int K, int MM, int lda, const float *restrict A, float *restrict AA)
+{
+  int vl = svcntw();
+  svbool_t all = svptrue_b32();
+  svbool_t p0 = svwhilelt_b32_s32(0, MM);
+  svbool_t p1 = svwhilelt_b32_s32(vl, MM);
+  for (int k = 0; k < K; k++)
+  {
+    svst1_f32(all, AA + k * 2 * vl, svld1_f32(p0, A + k * lda));
+    svst1_f32(all, AA + k * 2 * vl + vl, svld1_f32(p1, A + vl + k * lda));
+  }
+}
+
+// pack K x NN panel of B transposed into BB, columns beyond NN are zero
+static void pack_b(int K, int NN, int ldb, const float *restrict B, float *restrict BB)
+{
+  for (int ii = 0; ii < K; ii++)
+  {
+    for (int jj = 0; jj < SMALL_BLOCK_SIZE; jj++)
+    {
+      BB[jj + ii * SMALL_BLOCK_SIZE] = jj < NN ? B[ii + jj * ldb] : 0.0f;
+    }
+  }
+}
+
+// two level blocking
+// A: MxK, B: KxN, C: MxN
+// M and K must not exceed BLOCK_SIZE
+static void do_block_large(int M, int N, int K, int lda, const float *restrict A, int ldb, const float *restrict B, int ldc, float *restrict C)
+{
+  int rows = 2 * svcntw();
+  // buffer for packing, M rounded up to whole register tiles
+  float AA[(BLOCK_SIZE + MAX_SMALL_BLOCK_ROWS) * BLOCK_SIZE];
+  float BB[BLOCK_SIZE * SMALL_BLOCK_SIZE];
+
+  /* For each block-column of C */
+  for (int j = 0; j < N; j += SMALL_BLOCK_SIZE)
+  {
+    int NN = min(SMALL_BLOCK_SIZE, N - j);
+    pack_b(K, NN, ldb, B + j * ldb, BB);
+
+    /* For each block-row of C */
+    for (int i = 0; i < M; i += rows)
+    {
+      int MM = min(rows, M - i);
+
+      // pack A only once
+      if (j == 0)
+      {
+        pack_a(K, MM, lda, A + i, AA + i * K);
+      }
+
+      do_block_small(K, MM, NN, AA + i * K, BB, ldc, C + i + j * ldc);
+    }
+  }
+}
+
+void sgemm_rect(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  /* For each block-row of A */
+  for (int i = 0; i < M; i += BLOCK_SIZE)
+  {
+    int MM = min(BLOCK_SIZE, M - i);
+    /* For each block-column of A */
+    for (int j = 0; j < K; j += BLOCK_SIZE)
+    {
+      int KK = min(BLOCK_SIZE, K - j);
+
+      do_block_large(MM, N, KK, lda, A + i + j * lda, ldb, B + j, ldc, C + i);
+    }
+  }
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A, B, and C are lda-by-lda matrices stored in column-major format.
+ * On exit, A and B maintain their input values. */
+void square_sgemm(int lda, float *restrict A, float *restrict B, float *restrict C)
+{
+  sgemm_rect(lda, lda, lda, lda, A, lda, B, lda, C);
+}
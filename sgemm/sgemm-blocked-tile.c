@@ -0,0 +1,196 @@
+#include "sgemm-kernel.h"
+#include "sgemm.h"
+
+// register tile TILE_MR x TILE_NR, chosen per build (see Makefile):
+// 12x8: 24 accumulators, 24 FMAs per 5 loads
+// 8x12: 24 accumulators, 24 FMAs per 5 loads
+// 16x4: 16 accumulators, 16 FMAs per 5 loads, shorter B panels
+#if !defined(TILE_MR)
+#define TILE_MR 12
+#endif
+#if !defined(TILE_NR)
+#define TILE_NR 8
+#endif
+
+#if TILE_MR % 4 || TILE_NR % 4
+#error "TILE_MR and TILE_NR must be multiples of 4"
+#endif
+// accumulators plus one row of A and one of B have to stay in the 32 vector registers
+#if TILE_MR / 4 * TILE_NR + TILE_MR / 4 + TILE_NR / 4 > 32
+#error "register tile does not fit in 32 vector registers"
+#endif
+#if BLOCK_SIZE % TILE_MR
+#error "BLOCK_SIZE must be a multiple of TILE_MR"
+#endif
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+const char *sgemm_desc = "Blocked sgemm, " STR(TILE_MR) "x" STR(TILE_NR) " register tile.";
+
+void sgemm_set_prefetch(int distance)
+{
+  set_prefetch_distance(distance);
+}
+
+// C: TILE_MR x TILE_NR, AA: TILE_MR x K packed, BB: K x TILE_NR packed transposed
+// the loops are fully unrolled so that c, a and b become registers
+static void do_block_tile(int K, const float *restrict AA, const float *restrict BB, int ldc, float *restrict C)
+{
+  float32x4_t c[TILE_NR][TILE_MR / 4];
+
+#pragma GCC unroll 16
+  for (int j = 0; j < TILE_NR; j++)
+#pragma GCC unroll 4
+    for (int i = 0; i < TILE_MR / 4; i++)
+      c[j][i] = vld1q_f32(C + 4 * i + j * ldc);
+
+#pragma GCC unroll 4
+  for (int k = 0; k < K; ++k)
+  {
+    float32x4_t a[TILE_MR / 4];
+#pragma GCC unroll 4
+    for (int i = 0; i < TILE_MR / 4; i++)
+      a[i] = vld1q_f32(AA + k * TILE_MR + 4 * i);
+
+#pragma GCC unroll 4
+    for (int jb = 0; jb < TILE_NR / 4; jb++)
+    {
+      float32x4_t b = vld1q_f32(BB + k * TILE_NR + 4 * jb);
+#pragma GCC unroll 4
+      for (int i = 0; i < TILE_MR / 4; i++)
+      {
+        c[4 * jb + 0][i] = vmlaq_laneq_f32(c[4 * jb + 0][i], a[i], b, 0);
+        c[4 * jb + 1][i] = vmlaq_laneq_f32(c[4 * jb + 1][i], a[i], b, 1);
+        c[4 * jb + 2][i] = vmlaq_laneq_f32(c[4 * jb + 2][i], a[i], b, 2);
+        c[4 * jb + 3][i] = vmlaq_laneq_f32(c[4 * jb + 3][i], a[i], b, 3);
+      }
+    }
+  }
+
+#pragma GCC unroll 16
+  for (int j = 0; j < TILE_NR; j++)
+#pragma GCC unroll 4
+    for (int i = 0; i < TILE_MR / 4; i++)
+      vst1q_f32(C + 4 * i + j * ldc, c[j][i]);
+}
+
+// pack K x NN panel of B transposed into BB: BB[jj + ii * TILE_NR]
+// columns beyond NN are padded with zero
+static void pack_b_tile(int K, int NN, int ldb, const float *restrict B, float *restrict BB)
+{
+  int ii = 0;
+  if (NN == TILE_NR)
+  {
+    for (; ii + 4 <= K; ii += 4)
+    {
+      for (int jj = 0; jj < TILE_NR; jj += 4)
+      {
+        float32x4_t r0, r1, r2, r3;
+        transpose_4x4(vld1q_f32(B + ii + (jj + 0) * ldb), vld1q_f32(B + ii + (jj + 1) * ldb),
+                      vld1q_f32(B + ii + (jj + 2) * ldb), vld1q_f32(B + ii + (jj + 3) * ldb),
+                      &r0, &r1, &r2, &r3);
+        vst1q_f32(BB + jj + (ii + 0) * TILE_NR, r0);
+        vst1q_f32(BB + jj + (ii + 1) * TILE_NR, r1);
+        vst1q_f32(BB + jj + (ii + 2) * TILE_NR, r2);
+        vst1q_f32(BB + jj + (ii + 3) * TILE_NR, r3);
+      }
+    }
+  }
+  for (; ii < K; ii++)
+  {
+    for (int jj = 0; jj < TILE_NR; jj++)
+    {
+      BB[jj + ii * TILE_NR] = jj < NN ? B[ii + jj * ldb] : 0.0f;
+    }
+  }
+}
+
+// pack MM x K panel of A into AA: AA[ii + jj * TILE_MR]
+// rows beyond MM are padded with zero
+static void pack_a_tile(int K, int MM, int lda, const float *restrict A, float *restrict AA)
+{
+  if (MM == TILE_MR)
+  {
+    for (int jj = 0; jj < K; jj++)
+#pragma GCC unroll 4
+      for (int ii = 0; ii < TILE_MR; ii += 4)
+        vst1q_f32(AA + ii + jj * TILE_MR, vld1q_f32(A + ii + jj * lda));
+  }
+  else
+  {
+    for (int jj = 0; jj < K; jj++)
+      for (int ii = 0; ii < TILE_MR; ii++)
+        AA[ii + jj * TILE_MR] = ii < MM ? A[ii + jj * lda] : 0.0f;
+  }
+}
+
+// two level blocking
+// A: MxK, B: KxN, C: MxN
+// M and K must not exceed BLOCK_SIZE
+static void do_block_large_tile(int M, int N, int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C)
+{
+  // buffer for packing
+  float AA[BLOCK_SIZE * BLOCK_SIZE];
+  float BB[BLOCK_SIZE * TILE_NR];
+  float CC[TILE_MR * TILE_NR];
+
+  /* For each block-column of C */
+  for (int j = 0; j < N; j += TILE_NR)
+  {
+    int NN = min(TILE_NR, N - j);
+    pack_b_tile(K, NN, ldb, B + j * ldb, BB);
+
+    /* For each block-row of C */
+    for (int i = 0; i < M; i += TILE_MR)
+    {
+      int MM = min(TILE_MR, M - i);
+
+      // pack A only once
+      if (j == 0)
+      {
+        pack_a_tile(K, MM, lda, A + i, AA + i * K);
+      }
+
+      if (MM == TILE_MR && NN == TILE_NR)
+      {
+        do_block_tile(K, AA + i * K, BB, ldc, C + i + j * ldc);
+        continue;
+      }
+
+      // align to the tile size through CC
+      for (int jj = 0; jj < NN; jj++)
+        for (int ii = 0; ii < MM; ii++)
+          CC[ii + jj * TILE_MR] = C[(ii + i) + (jj + j) * ldc];
+      do_block_tile(K, AA + i * K, BB, TILE_MR, CC);
+      for (int jj = 0; jj < NN; jj++)
+        for (int ii = 0; ii < MM; ii++)
+          C[(ii + i) + (jj + j) * ldc] = CC[ii + jj * TILE_MR];
+    }
+  }
+}
+
+void sgemm_rect(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  /* For each block-row of A */
+  for (int i = 0; i < M; i += BLOCK_SIZE)
+  {
+    int MM = min(BLOCK_SIZE, M - i);
+    /* For each block-column of A */
+    for (int j = 0; j < K; j += BLOCK_SIZE)
+    {
+      int KK = min(BLOCK_SIZE, K - j);
+
+      do_block_large_tile(MM, N, KK, lda, A + i + j * lda, ldb, B + j, ldc, C + i);
+    }
+  }
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A, B, and C are lda-by-lda matrices stored in column-major format.
+ * On exit, A and B maintain their input values. */
+void square_sgemm(int lda, float *restrict A, float *restrict B, float *restrict C)
+{
+  sgemm_rect(lda, lda, lda, lda, A, lda, B, lda, C);
+}
@@ -1,183 +1,332 @@
-#define SIMDE_ENABLE_NATIVE_ALIASES
-#include "simde/arm/neon.h"
-#include "simde/arm/neon/mla_lane.h"
+#define _GNU_SOURCE
+#include <stdlib.h>   // For: malloc, free, getenv, atol
+#include <stdint.h>   // For: uintptr_t
+#include <limits.h>   // For: INT_MAX
+#include <fcntl.h>    // For: open
+#include <sys/mman.h> // For: mmap, munmap, madvise
+#include <sys/stat.h> // For: fstat
+#include <unistd.h>   // For: close, sysconf
+
+#include "sgemm-denormal.h"
+#include "sgemm-kernel.h"
+#include "sgemm-trace.h"
+#include "sgemm.h"
 
 const char *sgemm_desc = "Simple blocked sgemm.";
 
-#if !defined(BLOCK_SIZE)
-#define BLOCK_SIZE 96
-#endif
+void sgemm_set_prefetch(int distance)
+{
+  set_prefetch_distance(distance);
+}
+
+void sgemm_set_denormals(int mode)
+{
+  set_denormal_mode(mode);
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A, B, and C are lda-by-lda matrices stored in column-major format. 
+ * On exit, A and B maintain their input values. */
+void square_sgemm(int lda, float *restrict A, float *restrict B, float *restrict C)
+{
+  uint64_t start = trace_start(), saved = denormals_enter();
+  sgemm_blocked(lda, lda, lda, lda, A, lda, B, lda, C);
+  denormals_leave(saved);
+  trace_end(start, lda, lda, lda, A, 1, lda, B, 1, lda, 1, lda);
+}
+
+void sgemm_rect(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  uint64_t start = trace_start(), saved = denormals_enter();
+  sgemm_blocked(M, N, K, lda, A, ldb, B, ldc, C);
+  denormals_leave(saved);
+  trace_end(start, M, N, K, A, 1, lda, B, 1, ldb, 1, ldc);
+}
+
+void sgemm_strided(int M, int N, int K, float *A, int rsa, int csa, float *B, int rsb, int csb, float *C, int rsc, int csc)
+{
+  uint64_t start = trace_start(), saved = denormals_enter();
+  sgemm_strided_blocked(M, N, K, A, rsa, csa, B, rsb, csb, C, rsc, csc);
+  denormals_leave(saved);
+  trace_end(start, M, N, K, A, rsa, csa, B, rsb, csb, rsc, csc);
+}
+
+// 'R' row-major, anything else column-major
+static void layout_strides(char layout, int ld, int *rs, int *cs)
+{
+  int row_major = layout == 'R' || layout == 'r';
+  *rs = row_major ? ld : 1;
+  *cs = row_major ? 1 : ld;
+}
+
+void sgemm_layout(int M, int N, int K, char layout_a, int lda, float *A, char layout_b, int ldb, float *B, char layout_c, int ldc, float *C)
+{
+  int rsa, csa, rsb, csb, rsc, csc;
+  layout_strides(layout_a, lda, &rsa, &csa);
+  layout_strides(layout_b, ldb, &rsb, &csb);
+  layout_strides(layout_c, ldc, &rsc, &csc);
+  uint64_t start = trace_start(), saved = denormals_enter();
+  sgemm_strided_blocked(M, N, K, A, rsa, csa, B, rsb, csb, C, rsc, csc);
+  denormals_leave(saved);
+  trace_end(start, M, N, K, A, rsa, csa, B, rsb, csb, rsc, csc);
+}
+
+// 8x8 tile on the diagonal of C: the whole product goes to a scratch tile,
+// only the elements of the triangle are added to C
+static void do_block_diagonal(int lower, int MM, int K, float *restrict AA, float *restrict BB, int ldc, float *restrict C)
+{
+  float CC[SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE] = {0};
+  do_block_small(K, SMALL_BLOCK_SIZE, AA, SMALL_BLOCK_SIZE, BB, SMALL_BLOCK_SIZE, CC);
 
-#define SMALL_BLOCK_SIZE 8
-
-#define min(a, b) (((a) < (b)) ? (a) : (b))
-
-// let compiler optimize for M = N = SMALL_BLOCK_SIZE
-// so that numbers can reside in registers
-// lda, ldb, ldc: load stripe
-// A: SMALL_BLOCK_SIZE * K
-// B: K * SMALL_BLOCK_SIZE
-// C: SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE
-static void do_block_small(int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C)
-{
-  int M = SMALL_BLOCK_SIZE, N = SMALL_BLOCK_SIZE;
-  // four rows of C
-  // 16 registers
-  // C00: C[0-3, 0], C40: C[4-7, 0]
-  float32x4_t C00, C40, C01, C41, C02, C42, C03, C43, C04, C44, C05, C45, C06, C46, C07, C47;
-  // temporaries
-  float32x4_t a0, a4;
-
-  // pack
-  C00 = vld1q_f32(C + 0 * ldc + 0);
-  C40 = vld1q_f32(C + 0 * ldc + 4);
-  C01 = vld1q_f32(C + 1 * ldc + 0);
-  C41 = vld1q_f32(C + 1 * ldc + 4);
-  C02 = vld1q_f32(C + 2 * ldc + 0);
-  C42 = vld1q_f32(C + 2 * ldc + 4);
-  C03 = vld1q_f32(C + 3 * ldc + 0);
-  C43 = vld1q_f32(C + 3 * ldc + 4);
-  C04 = vld1q_f32(C + 4 * ldc + 0);
-  C44 = vld1q_f32(C + 4 * ldc + 4);
-  C05 = vld1q_f32(C + 5 * ldc + 0);
-  C45 = vld1q_f32(C + 5 * ldc + 4);
-  C06 = vld1q_f32(C + 6 * ldc + 0);
-  C46 = vld1q_f32(C + 6 * ldc + 4);
-  C07 = vld1q_f32(C + 7 * ldc + 0);
-  C47 = vld1q_f32(C + 7 * ldc + 4);
-
-#pragma GCC unroll 8
-  for (int k = 0; k < K; ++k)
+  for (int jj = 0; jj < MM; jj++)
   {
-    /* Compute C(i,j) */
-    a0 = vld1q_f32(A + k * ldb + 0);
-    a4 = vld1q_f32(A + k * ldb + 4);
-
-    float32x4_t B0 = vld1q_f32(B + k * lda);
-    C00 = vmlaq_laneq_f32(C00, a0, B0, 0);
-    C40 = vmlaq_laneq_f32(C40, a4, B0, 0);
-    C01 = vmlaq_laneq_f32(C01, a0, B0, 1);
-    C41 = vmlaq_laneq_f32(C41, a4, B0, 1);
-    C02 = vmlaq_laneq_f32(C02, a0, B0, 2);
-    C42 = vmlaq_laneq_f32(C42, a4, B0, 2);
-    C03 = vmlaq_laneq_f32(C03, a0, B0, 3);
-    C43 = vmlaq_laneq_f32(C43, a4, B0, 3);
-
-    float32x4_t B4 = vld1q_f32(B + 4 + k * lda);
-    C04 = vmlaq_laneq_f32(C04, a0, B4, 0);
-    C44 = vmlaq_laneq_f32(C44, a4, B4, 0);
-    C05 = vmlaq_laneq_f32(C05, a0, B4, 1);
-    C45 = vmlaq_laneq_f32(C45, a4, B4, 1);
-    C06 = vmlaq_laneq_f32(C06, a0, B4, 2);
-    C46 = vmlaq_laneq_f32(C46, a4, B4, 2);
-    C07 = vmlaq_laneq_f32(C07, a0, B4, 3);
-    C47 = vmlaq_laneq_f32(C47, a4, B4, 3);
+    int first = lower ? jj : 0;
+    int last = lower ? MM : jj + 1;
+    for (int ii = first; ii < last; ii++)
+    {
+      C[ii + jj * ldc] += CC[ii + jj * SMALL_BLOCK_SIZE];
+    }
   }
+}
 
-  // unpack
-  vst1q_f32(C + 0 * ldc + 0, C00);
-  vst1q_f32(C + 0 * ldc + 4, C40);
-  vst1q_f32(C + 1 * ldc + 0, C01);
-  vst1q_f32(C + 1 * ldc + 4, C41);
-  vst1q_f32(C + 2 * ldc + 0, C02);
-  vst1q_f32(C + 2 * ldc + 4, C42);
-  vst1q_f32(C + 3 * ldc + 0, C03);
-  vst1q_f32(C + 3 * ldc + 4, C43);
-  vst1q_f32(C + 4 * ldc + 0, C04);
-  vst1q_f32(C + 4 * ldc + 4, C44);
-  vst1q_f32(C + 5 * ldc + 0, C05);
-  vst1q_f32(C + 5 * ldc + 4, C45);
-  vst1q_f32(C + 6 * ldc + 0, C06);
-  vst1q_f32(C + 6 * ldc + 4, C46);
-  vst1q_f32(C + 7 * ldc + 0, C07);
-  vst1q_f32(C + 7 * ldc + 4, C47);
-}
-
-// two level blocking
-// A: MxK, B: KxN, C: MxN
-static void do_block_large(int M, int N, int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C)
-{
-  // buffer for packing
-  float AA[BLOCK_SIZE * BLOCK_SIZE];
-  float BB[BLOCK_SIZE * BLOCK_SIZE];
-  float CC[SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE];
-
-  /* For each block-column of C */
-  for (int j = 0; j < N; j += SMALL_BLOCK_SIZE)
+/* This routine performs a ssyrk operation
+ *  C := C + A * A^T
+ * on the lower (uplo 'L') or upper (uplo 'U') triangle of the N-by-N matrix C,
+ * where A is N-by-K. Tiles of C outside the triangle are skipped. */
+int sgemm_syrk(char uplo, int N, int K, int lda, float *A, int ldc, float *C)
+{
+  int lower = uplo == 'L' || uplo == 'l';
+  int NP = (N + SMALL_BLOCK_SIZE - 1) / SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE;
+
+  // a panel of A^T as pack_b lays it out is the same rows of A as pack_a lays
+  // them out, so one packed copy of each block-column of A serves both sides
+  float *AP = (float *)malloc(sizeof(float) * NP * min(K, BLOCK_SIZE));
+  if (AP == NULL)
+    return 0;
+
+  /* For each block-column of A */
+  for (int p = 0; p < K; p += BLOCK_SIZE)
   {
-    int NN = min(SMALL_BLOCK_SIZE, N - j);
-    // pack B with transpose
-    for (int ii = 0; ii < K; ii++)
+    int KK = min(BLOCK_SIZE, K - p);
+    for (int j = 0; j < N; j += SMALL_BLOCK_SIZE)
     {
-      for (int jj = 0; jj < SMALL_BLOCK_SIZE; jj++)
-      {
-        BB[jj + ii * SMALL_BLOCK_SIZE] = B[ii + (jj + j) * lda];
-      }
+      pack_a(KK, min(SMALL_BLOCK_SIZE, N - j), lda, A + j + p * lda, AP + j * KK);
     }
 
     /* For each block-row of C */
-    for (int i = 0; i < M; i += SMALL_BLOCK_SIZE)
+    for (int i = 0; i < N; i += BLOCK_SIZE)
     {
-      int MM = min(SMALL_BLOCK_SIZE, M - i);
+      int MB = min(BLOCK_SIZE, N - i);
+      // block-columns that reach into the triangle
+      int j0 = lower ? 0 : i;
+      int j1 = lower ? i + MB : N;
 
-      // pack A only once
-      if (j == 0)
+      for (int j = j0; j < j1; j += SMALL_BLOCK_SIZE)
       {
-        for (int jj = 0; jj < K; jj++)
+        int NN = min(SMALL_BLOCK_SIZE, N - j);
+        for (int ii = i; ii < i + MB; ii += SMALL_BLOCK_SIZE)
         {
-          for (int ii = 0; ii < SMALL_BLOCK_SIZE; ii++)
-          {
-            AA[ii + jj * SMALL_BLOCK_SIZE + i * K] = A[(ii + i) + jj * lda];
-          }
+          int MM = min(SMALL_BLOCK_SIZE, N - ii);
+          if (ii == j)
+            do_block_diagonal(lower, MM, KK, AP + ii * KK, AP + j * KK, ldc, C + ii + j * ldc);
+          else if (lower ? j < ii : j > ii)
+            do_block_edge(MM, NN, KK, AP + ii * KK, AP + j * KK, ldc, C + ii + j * ldc);
         }
       }
+    }
+  }
 
-      /* Perform individual block sgemm */
-      if (MM == SMALL_BLOCK_SIZE && NN == SMALL_BLOCK_SIZE)
-      {
-        do_block_small(K, SMALL_BLOCK_SIZE, AA + i * K, SMALL_BLOCK_SIZE, BB, lda, C + i + j * lda);
-      }
-      else
-      {
-        // align to small block size and use the function above
-        for (int jj = 0; jj < NN; jj++)
-        {
-          for (int ii = 0; ii < MM; ii++)
-          {
-            CC[ii + jj * SMALL_BLOCK_SIZE] = C[(ii + i) + (jj + j) * lda];
-          }
-        }
-        do_block_small(K, SMALL_BLOCK_SIZE, AA + i * K, SMALL_BLOCK_SIZE, BB, SMALL_BLOCK_SIZE, CC);
+  free(AP);
+  return 1;
+}
 
-        // write back to C
-        for (int jj = 0; jj < NN; jj++)
-        {
-          for (int ii = 0; ii < MM; ii++)
-          {
-            C[(ii + i) + (jj + j) * lda] = CC[ii + jj * SMALL_BLOCK_SIZE];
-          }
-        }
+// B := A * B for at most 8 rows: A is packed with the entries outside the
+// triangle zeroed, B is packed into panels and then overwritten with the product
+static void trmm_tile(int lower, int M, int N, int lda, float *A, int ldb, float *B)
+{
+  float AA[SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE];
+  float BB[SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE];
+
+  for (int k = 0; k < SMALL_BLOCK_SIZE; k++)
+  {
+    for (int ii = 0; ii < SMALL_BLOCK_SIZE; ii++)
+    {
+      int inside = ii < M && k < M && (lower ? k <= ii : k >= ii);
+      AA[ii + k * SMALL_BLOCK_SIZE] = inside ? A[ii + k * lda] : 0.0f;
+    }
+  }
+
+  /* For each block-column of B */
+  for (int j = 0; j < N; j += SMALL_BLOCK_SIZE)
+  {
+    int NN = min(SMALL_BLOCK_SIZE, N - j);
+    pack_b(M, NN, ldb, B + j * ldb, BB);
+    for (int jj = 0; jj < NN; jj++)
+    {
+      for (int ii = 0; ii < M; ii++)
+      {
+        B[ii + (j + jj) * ldb] = 0;
       }
     }
+    do_block_edge(M, NN, M, AA, BB, ldb, B + j * ldb);
   }
 }
 
-/* This routine performs a sgemm operation
- *  C := C + A * B
- * where A, B, and C are lda-by-lda matrices stored in column-major format. 
- * On exit, A and B maintain their input values. */
-void square_sgemm(int lda, float *restrict A, float *restrict B, float *restrict C)
+/* This routine performs a strmm operation
+ *  B := A * B
+ * where A is the M-by-M lower (uplo 'L') or upper (uplo 'U') triangular
+ * matrix and B is M-by-N, in place. With A split at M1 rows,
+ *  lower: B2 := A22 * B2 + A21 * B1, then B1 := A11 * B1
+ *  upper: B1 := A11 * B1 + A12 * B2, then B2 := A22 * B2
+ * so the blocks above or below the diagonal are plain GEMM and the
+ * triangles shrink down to masked 8x8 tiles. */
+void sgemm_trmm(char uplo, int M, int N, int lda, float *A, int ldb, float *B)
 {
-  /* For each block-row of A */
-  for (int i = 0; i < lda; i += BLOCK_SIZE)
+  int lower = uplo == 'L' || uplo == 'l';
+  if (M <= SMALL_BLOCK_SIZE)
   {
-    int M = min(BLOCK_SIZE, lda - i);
-    /* For each block-column of A */
-    for (int j = 0; j < lda; j += BLOCK_SIZE)
-    {
-      int K = min(BLOCK_SIZE, lda - j);
+    trmm_tile(lower, M, N, lda, A, ldb, B);
+    return;
+  }
+
+  // a multiple of the tile size, so the masked tiles stay on the diagonal
+  int M1 = (M / 2 + SMALL_BLOCK_SIZE - 1) / SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE;
+  int M2 = M - M1;
+  float *A22 = A + M1 + M1 * lda;
+  if (lower)
+  {
+    sgemm_trmm(uplo, M2, N, lda, A22, ldb, B + M1);
+    sgemm_blocked(M2, N, M1, lda, A + M1, ldb, B, ldb, B + M1);
+    sgemm_trmm(uplo, M1, N, lda, A, ldb, B);
+  }
+  else
+  {
+    sgemm_trmm(uplo, M1, N, lda, A, ldb, B);
+    sgemm_blocked(M1, N, M2, lda, A + M1 * lda, ldb, B + M1, ldb, B);
+    sgemm_trmm(uplo, M2, N, lda, A22, ldb, B + M1);
+  }
+}
+
+// out of core: memory the panels of one step may occupy, SGEMM_OOC_MEMORY in MiB
+#if !defined(OOC_MEMORY_MB)
+#define OOC_MEMORY_MB 1024
+#endif
 
-      do_block_large(M, lda, K, lda, A + i + j * lda, lda, B + j + 0 * lda, lda, C + i + 0 * lda);
+// map count floats of a file, NULL if it cannot be opened or is too short
+static float *map_matrix(const char *path, size_t count, int writable)
+{
+  int fd = open(path, writable ? O_RDWR : O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  float *p = NULL;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= count * sizeof(float))
+  {
+    p = (float *)mmap(NULL, count * sizeof(float), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+      p = NULL;
+  }
+  close(fd);
+  return p;
+}
+
+// have the kernel read [p, p + count) in the background
+static void read_ahead(const float *p, size_t count)
+{
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)p & ~(page - 1);
+  madvise((void *)start, (uintptr_t)(p + count) - start, MADV_WILLNEED);
+}
+
+// drop the whole pages inside [p, p + count) from the mapping once consumed,
+// writing them back first when dirty; the neighbours' pages stay
+static void release(float *p, size_t count, int dirty)
+{
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = ((uintptr_t)p + page - 1) & ~(page - 1);
+  uintptr_t end = (uintptr_t)(p + count) & ~(page - 1);
+  if (dirty)
+  {
+    uintptr_t first = (uintptr_t)p & ~(page - 1);
+    msync((void *)first, (uintptr_t)(p + count) - first, MS_SYNC);
+  }
+  if (end > start)
+    madvise((void *)start, end - start, MADV_DONTNEED);
+}
+
+// the next A chunk and B block after (p, j), possibly of the next panel of C
+static void read_ahead_step(int M, int N, int K, int NC, int KC, int p, int j, float *A, float *B, float *C)
+{
+  p += KC;
+  if (p >= K)
+  {
+    p = 0;
+    j += NC;
+    if (j >= N)
+      return;
+    read_ahead(C + (size_t)j * M, (size_t)M * min(NC, N - j));
+  }
+  int KK = min(KC, K - p);
+  read_ahead(A + (size_t)p * M, (size_t)M * KK);
+  for (int jj = j; jj < min(j + NC, N); jj++)
+    read_ahead(B + p + (size_t)jj * K, KK);
+}
+
+/* C := C + A * B on column-major matrices in files of raw floats, mapped and
+ * multiplied a step at a time: an M x NC panel of C stays while M x KC chunks
+ * of A and KC x NC blocks of B stream past, the next ones read in the
+ * background meanwhile, the consumed ones dropped from the mapping. Every
+ * step is an in-memory sgemm_blocked. */
+int sgemm_file(int M, int N, int K, const char *a, const char *b, const char *c)
+{
+  if (M < 0 || N < 0 || K < 0)
+    return 0;
+  // nothing to add to C, the files are not even opened
+  if (M == 0 || N == 0 || K == 0)
+    return 1;
+  char *env = getenv("SGEMM_OOC_MEMORY");
+  long mb = env ? atol(env) : OOC_MEMORY_MB;
+  if (mb <= 0)
+    return 0;
+  size_t budget = (size_t)mb << 20;
+  // half for the panel of C, a quarter for each of the current and next chunk of A
+  size_t column = sizeof(float) * M;
+  int NC = min((size_t)N, budget / 2 / column / SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE);
+  int KC = min((size_t)K, budget / 4 / column / BLOCK_SIZE * BLOCK_SIZE);
+  if (NC < SMALL_BLOCK_SIZE)
+    NC = min(N, SMALL_BLOCK_SIZE);
+  if (KC < BLOCK_SIZE)
+    KC = min(K, BLOCK_SIZE);
+  // the kernels index within one step with int
+  if ((long)M * NC > INT_MAX || (long)M * KC > INT_MAX || (long)K * NC > INT_MAX)
+    return 0;
+
+  float *A = map_matrix(a, (size_t)M * K, 0);
+  float *B = map_matrix(b, (size_t)K * N, 0);
+  float *C = map_matrix(c, (size_t)M * N, 1);
+  if (A && B && C)
+  {
+    read_ahead(C, (size_t)M * NC);
+    read_ahead_step(M, N, K, NC, KC, -KC, 0, A, B, C);
+    for (int j = 0; j < N; j += NC)
+    {
+      int NN = min(NC, N - j);
+      for (int p = 0; p < K; p += KC)
+      {
+        read_ahead_step(M, N, K, NC, KC, p, j, A, B, C);
+        sgemm_blocked(M, NN, min(KC, K - p), M, A + (size_t)p * M, K, B + p + (size_t)j * K, M, C + (size_t)j * M);
+        release(A + (size_t)p * M, (size_t)M * min(KC, K - p), 0);
+      }
+      release(B + (size_t)j * K, (size_t)K * NN, 0);
+      release(C + (size_t)j * M, (size_t)M * NN, 1);
     }
   }
+  if (A)
+    munmap(A, (size_t)M * K * sizeof(float));
+  if (B)
+    munmap(B, (size_t)K * N * sizeof(float));
+  if (C)
+    munmap(C, (size_t)M * N * sizeof(float));
+  return A && B && C;
 }
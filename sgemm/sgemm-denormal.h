@@ -0,0 +1,80 @@
+// denormal handling of the calls: operations on denormal (subnormal) floats
+// take a microcode assist or a trap on many cores, tens to hundreds of cycles
+// each, while flushing them to zero costs nothing and loses only values below
+// FLT_MIN; the mode lives in the floating-point control register of every
+// thread, FPCR (FZ) on AArch64 and MXCSR (FTZ and DAZ) on x86-64
+// what mode a process starts in depends on the toolchain and the link flags,
+// so the library can set it both ways explicitly
+#ifndef SGEMM_DENORMAL_H
+#define SGEMM_DENORMAL_H
+
+#include <stdint.h>
+
+#if defined(__aarch64__)
+// FZ: denormal inputs and results are flushed to zero
+#define FP_FLUSH_BITS ((uint64_t)1 << 24)
+#elif defined(__x86_64__)
+// FTZ (bit 15): denormal results are flushed, DAZ (bit 6): denormal inputs read as zero
+#define FP_FLUSH_BITS ((uint64_t)1 << 15 | (uint64_t)1 << 6)
+#else
+#define FP_FLUSH_BITS 0
+#endif
+
+// -1 leaves the mode of the calling thread alone, 0 keeps denormals (IEEE
+// gradual underflow), 1 flushes them; changed at runtime with sgemm_set_denormals
+#if !defined(FLUSH_DENORMALS)
+#define FLUSH_DENORMALS -1
+#endif
+
+static int flush_denormals = FLUSH_DENORMALS;
+
+// the variants export it as sgemm_set_denormals
+static inline void set_denormal_mode(int mode)
+{
+  flush_denormals = mode < 0 ? -1 : mode > 0;
+}
+
+static inline uint64_t fp_control_get()
+{
+#if defined(__aarch64__)
+  uint64_t r;
+  __asm__ volatile("mrs %0, fpcr" : "=r"(r));
+  return r;
+#elif defined(__x86_64__)
+  uint32_t r;
+  __asm__ volatile("stmxcsr %0" : "=m"(r));
+  return r;
+#else
+  return 0;
+#endif
+}
+
+static inline void fp_control_set(uint64_t r)
+{
+#if defined(__aarch64__)
+  __asm__ volatile("msr fpcr, %0" : : "r"(r));
+#elif defined(__x86_64__)
+  uint32_t m = (uint32_t)r;
+  __asm__ volatile("ldmxcsr %0" : : "m"(m));
+#else
+  (void)r;
+#endif
+}
+
+// at the start of a call: the mode asked for, returns what denormals_leave restores
+static inline uint64_t denormals_enter()
+{
+  uint64_t saved = fp_control_get();
+  if (flush_denormals >= 0)
+    fp_control_set(flush_denormals ? saved | FP_FLUSH_BITS : saved & ~FP_FLUSH_BITS);
+  return saved;
+}
+
+// at the end of a call: the caller's mode again
+static inline void denormals_leave(uint64_t saved)
+{
+  if (fp_control_get() != saved)
+    fp_control_set(saved);
+}
+
+#endif
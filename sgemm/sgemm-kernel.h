@@ -0,0 +1,728 @@
+// two-level blocked kernel shared by sgemm-blocked.c and the variants built on top of it
+#ifndef SGEMM_KERNEL_H
+#define SGEMM_KERNEL_H
+
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include "simde/arm/neon.h"
+#include "simde/arm/neon/mla_lane.h"
+
+#if !defined(BLOCK_SIZE)
+#define BLOCK_SIZE 96
+#endif
+
+#define SMALL_BLOCK_SIZE 8
+
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+// software prefetch distance in k steps (rows of a packed panel, columns of A
+// while packing), 0 disables it; changed at runtime with sgemm_set_prefetch
+#if !defined(PREFETCH_DISTANCE)
+#define PREFETCH_DISTANCE 0
+#endif
+
+static int prefetch_distance = PREFETCH_DISTANCE;
+
+// the variants export it as sgemm_set_prefetch
+static inline void set_prefetch_distance(int distance)
+{
+  prefetch_distance = distance > 0 ? distance : 0;
+}
+
+// prefetch the SMALL_BLOCK_SIZE columns of a C tile for writing
+static inline void prefetch_tile(int ldc, float *C)
+{
+  for (int jj = 0; jj < SMALL_BLOCK_SIZE; jj++)
+    __builtin_prefetch(C + jj * ldc, 1);
+}
+
+// let compiler optimize for M = N = SMALL_BLOCK_SIZE
+// so that numbers can reside in registers
+// lda, ldb, ldc: load stripe
+// A: SMALL_BLOCK_SIZE * K
+// B: K * SMALL_BLOCK_SIZE
+// C: SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE
+static inline void do_block_small(int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C)
+{
+  int M = SMALL_BLOCK_SIZE, N = SMALL_BLOCK_SIZE;
+  // four rows of C
+  // 16 registers
+  // C00: C[0-3, 0], C40: C[4-7, 0]
+  float32x4_t C00, C40, C01, C41, C02, C42, C03, C43, C04, C44, C05, C45, C06, C46, C07, C47;
+  // temporaries
+  float32x4_t a0, a4;
+
+  // pack
+  C00 = vld1q_f32(C + 0 * ldc + 0);
+  C40 = vld1q_f32(C + 0 * ldc + 4);
+  C01 = vld1q_f32(C + 1 * ldc + 0);
+  C41 = vld1q_f32(C + 1 * ldc + 4);
+  C02 = vld1q_f32(C + 2 * ldc + 0);
+  C42 = vld1q_f32(C + 2 * ldc + 4);
+  C03 = vld1q_f32(C + 3 * ldc + 0);
+  C43 = vld1q_f32(C + 3 * ldc + 4);
+  C04 = vld1q_f32(C + 4 * ldc + 0);
+  C44 = vld1q_f32(C + 4 * ldc + 4);
+  C05 = vld1q_f32(C + 5 * ldc + 0);
+  C45 = vld1q_f32(C + 5 * ldc + 4);
+  C06 = vld1q_f32(C + 6 * ldc + 0);
+  C46 = vld1q_f32(C + 6 * ldc + 4);
+  C07 = vld1q_f32(C + 7 * ldc + 0);
+  C47 = vld1q_f32(C + 7 * ldc + 4);
+
+#pragma GCC unroll 8
+  for (int k = 0; k < K; ++k)
+  {
+    // one cache line holds two rows of a packed panel, the rows past
+    // the end of this panel are the start of the next one
+    if (prefetch_distance && k % 2 == 0)
+    {
+      __builtin_prefetch(A + (k + prefetch_distance) * ldb);
+      __builtin_prefetch(B + (k + prefetch_distance) * lda);
+    }
+
+    /* Compute C(i,j) */
+    a0 = vld1q_f32(A + k * ldb + 0);
+    a4 = vld1q_f32(A + k * ldb + 4);
+
+    float32x4_t B0 = vld1q_f32(B + k * lda);
+    C00 = vmlaq_laneq_f32(C00, a0, B0, 0);
+    C40 = vmlaq_laneq_f32(C40, a4, B0, 0);
+    C01 = vmlaq_laneq_f32(C01, a0, B0, 1);
+    C41 = vmlaq_laneq_f32(C41, a4, B0, 1);
+    C02 = vmlaq_laneq_f32(C02, a0, B0, 2);
+    C42 = vmlaq_laneq_f32(C42, a4, B0, 2);
+    C03 = vmlaq_laneq_f32(C03, a0, B0, 3);
+    C43 = vmlaq_laneq_f32(C43, a4, B0, 3);
+
+    float32x4_t B4 = vld1q_f32(B + 4 + k * lda);
+    C04 = vmlaq_laneq_f32(C04, a0, B4, 0);
+    C44 = vmlaq_laneq_f32(C44, a4, B4, 0);
+    C05 = vmlaq_laneq_f32(C05, a0, B4, 1);
+    C45 = vmlaq_laneq_f32(C45, a4, B4, 1);
+    C06 = vmlaq_laneq_f32(C06, a0, B4, 2);
+    C46 = vmlaq_laneq_f32(C46, a4, B4, 2);
+    C07 = vmlaq_laneq_f32(C07, a0, B4, 3);
+    C47 = vmlaq_laneq_f32(C47, a4, B4, 3);
+  }
+
+  // unpack
+  vst1q_f32(C + 0 * ldc + 0, C00);
+  vst1q_f32(C + 0 * ldc + 4, C40);
+  vst1q_f32(C + 1 * ldc + 0, C01);
+  vst1q_f32(C + 1 * ldc + 4, C41);
+  vst1q_f32(C + 2 * ldc + 0, C02);
+  vst1q_f32(C + 2 * ldc + 4, C42);
+  vst1q_f32(C + 3 * ldc + 0, C03);
+  vst1q_f32(C + 3 * ldc + 4, C43);
+  vst1q_f32(C + 4 * ldc + 0, C04);
+  vst1q_f32(C + 4 * ldc + 4, C44);
+  vst1q_f32(C + 5 * ldc + 0, C05);
+  vst1q_f32(C + 5 * ldc + 4, C45);
+  vst1q_f32(C + 6 * ldc + 0, C06);
+  vst1q_f32(C + 6 * ldc + 4, C46);
+  vst1q_f32(C + 7 * ldc + 0, C07);
+  vst1q_f32(C + 7 * ldc + 4, C47);
+}
+
+// columns c0..c3 of a 4x4 block in, its rows r0..r3 out
+// trn1/trn2 on 32-bit lanes pair up neighbouring columns, then on 64-bit lanes
+// pick the matching halves; SIMDe maps these to unpack/shuffle on x86
+static inline void transpose_4x4(float32x4_t c0, float32x4_t c1, float32x4_t c2, float32x4_t c3,
+                                 float32x4_t *r0, float32x4_t *r1, float32x4_t *r2, float32x4_t *r3)
+{
+  float64x2_t t0 = vreinterpretq_f64_f32(vtrn1q_f32(c0, c1));
+  float64x2_t t1 = vreinterpretq_f64_f32(vtrn2q_f32(c0, c1));
+  float64x2_t t2 = vreinterpretq_f64_f32(vtrn1q_f32(c2, c3));
+  float64x2_t t3 = vreinterpretq_f64_f32(vtrn2q_f32(c2, c3));
+  *r0 = vreinterpretq_f32_f64(vtrn1q_f64(t0, t2));
+  *r1 = vreinterpretq_f32_f64(vtrn1q_f64(t1, t3));
+  *r2 = vreinterpretq_f32_f64(vtrn2q_f64(t0, t2));
+  *r3 = vreinterpretq_f32_f64(vtrn2q_f64(t1, t3));
+}
+
+// pack K x NN panel of B transposed into BB: BB[jj + ii * SMALL_BLOCK_SIZE]
+// columns beyond NN are padded with zero
+static inline void pack_b(int K, int NN, int ldb, const float *restrict B, float *restrict BB)
+{
+  if (NN == SMALL_BLOCK_SIZE)
+  {
+    int ii = 0;
+    for (; ii + 4 <= K; ii += 4)
+    {
+      // eight column streams: fetch each one a line at a time
+      if (prefetch_distance && ii % 16 == 0)
+      {
+        for (int jj = 0; jj < SMALL_BLOCK_SIZE; jj++)
+          __builtin_prefetch(B + ii + prefetch_distance + jj * ldb);
+      }
+      // rows ii..ii+3 of columns 0-3, then of columns 4-7
+      for (int jj = 0; jj < SMALL_BLOCK_SIZE; jj += 4)
+      {
+        float32x4_t r0, r1, r2, r3;
+        transpose_4x4(vld1q_f32(B + ii + (jj + 0) * ldb), vld1q_f32(B + ii + (jj + 1) * ldb),
+                      vld1q_f32(B + ii + (jj + 2) * ldb), vld1q_f32(B + ii + (jj + 3) * ldb),
+                      &r0, &r1, &r2, &r3);
+        vst1q_f32(BB + jj + (ii + 0) * SMALL_BLOCK_SIZE, r0);
+        vst1q_f32(BB + jj + (ii + 1) * SMALL_BLOCK_SIZE, r1);
+        vst1q_f32(BB + jj + (ii + 2) * SMALL_BLOCK_SIZE, r2);
+        vst1q_f32(BB + jj + (ii + 3) * SMALL_BLOCK_SIZE, r3);
+      }
+    }
+    for (; ii < K; ii++)
+    {
+      for (int jj = 0; jj < SMALL_BLOCK_SIZE; jj++)
+      {
+        BB[jj + ii * SMALL_BLOCK_SIZE] = B[ii + jj * ldb];
+      }
+    }
+  }
+  else
+  {
+    for (int ii = 0; ii < K; ii++)
+    {
+      for (int jj = 0; jj < SMALL_BLOCK_SIZE; jj++)
+      {
+        BB[jj + ii * SMALL_BLOCK_SIZE] = jj < NN ? B[ii + jj * ldb] : 0.0f;
+      }
+    }
+  }
+}
+
+// pack MM x K panel of A into AA: AA[ii + jj * SMALL_BLOCK_SIZE]
+// rows beyond MM are padded with zero
+static inline void pack_a(int K, int MM, int lda, const float *restrict A, float *restrict AA)
+{
+  if (MM == SMALL_BLOCK_SIZE)
+  {
+    for (int jj = 0; jj < K; jj++)
+    {
+      if (prefetch_distance)
+        __builtin_prefetch(A + (jj + prefetch_distance) * lda);
+      // a column of the panel is contiguous on both sides
+      vst1q_f32(AA + jj * SMALL_BLOCK_SIZE + 0, vld1q_f32(A + jj * lda + 0));
+      vst1q_f32(AA + jj * SMALL_BLOCK_SIZE + 4, vld1q_f32(A + jj * lda + 4));
+    }
+  }
+  else
+  {
+    for (int jj = 0; jj < K; jj++)
+    {
+      for (int ii = 0; ii < SMALL_BLOCK_SIZE; ii++)
+      {
+        AA[ii + jj * SMALL_BLOCK_SIZE] = ii < MM ? A[ii + jj * lda] : 0.0f;
+      }
+    }
+  }
+}
+
+// variants can substitute their own 8x8 micro-kernel taking the same arguments
+#if !defined(DO_BLOCK_SMALL)
+#define DO_BLOCK_SMALL do_block_small
+#endif
+
+// run the 8x8 kernel on a tile of C that may be cut at the edge
+// partial tiles go through the CC scratch copy
+static inline void do_block_edge(int MM, int NN, int K, float *restrict AA, float *restrict BB, int ldc, float *restrict C)
+{
+  float CC[SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE];
+
+  if (MM == SMALL_BLOCK_SIZE && NN == SMALL_BLOCK_SIZE)
+  {
+    DO_BLOCK_SMALL(K, SMALL_BLOCK_SIZE, AA, SMALL_BLOCK_SIZE, BB, ldc, C);
+    return;
+  }
+
+  // align to small block size and use the function above
+  for (int jj = 0; jj < NN; jj++)
+  {
+    for (int ii = 0; ii < MM; ii++)
+    {
+      CC[ii + jj * SMALL_BLOCK_SIZE] = C[ii + jj * ldc];
+    }
+  }
+  DO_BLOCK_SMALL(K, SMALL_BLOCK_SIZE, AA, SMALL_BLOCK_SIZE, BB, SMALL_BLOCK_SIZE, CC);
+
+  // write back to C
+  for (int jj = 0; jj < NN; jj++)
+  {
+    for (int ii = 0; ii < MM; ii++)
+    {
+      C[ii + jj * ldc] = CC[ii + jj * SMALL_BLOCK_SIZE];
+    }
+  }
+}
+
+// two level blocking
+// A: MxK, B: KxN, C: MxN
+// M and K must not exceed BLOCK_SIZE
+static inline void do_block_large(int M, int N, int K, int lda, float *restrict A, int ldb, float *restrict B, int ldc, float *restrict C)
+{
+  // buffer for packing
+  float AA[BLOCK_SIZE * BLOCK_SIZE];
+  float BB[BLOCK_SIZE * SMALL_BLOCK_SIZE];
+
+  /* For each block-column of C */
+  for (int j = 0; j < N; j += SMALL_BLOCK_SIZE)
+  {
+    int NN = min(SMALL_BLOCK_SIZE, N - j);
+    // pack B with transpose
+    pack_b(K, NN, ldb, B + j * ldb, BB);
+
+    /* For each block-row of C */
+    for (int i = 0; i < M; i += SMALL_BLOCK_SIZE)
+    {
+      int MM = min(SMALL_BLOCK_SIZE, M - i);
+
+      // pack A only once
+      if (j == 0)
+      {
+        pack_a(K, MM, lda, A + i, AA + i * K);
+      }
+
+      // the next tile of C, before its accumulators are loaded
+      if (prefetch_distance && i + SMALL_BLOCK_SIZE < M)
+        prefetch_tile(ldc, C + i + SMALL_BLOCK_SIZE + j * ldc);
+
+      /* Perform individual block sgemm */
+      do_block_edge(MM, NN, K, AA + i * K, BB, ldc, C + i + j * ldc);
+    }
+  }
+}
+
+// same as do_block_large, but B is already packed:
+// panel j of BP holds columns j..j+SMALL_BLOCK_SIZE as written by pack_b, at BP + j * K
+static inline void do_block_prepacked(int M, int N, int K, int lda, float *restrict A, float *restrict BP, int ldc, float *restrict C)
+{
+  // buffer for packing
+  float AA[BLOCK_SIZE * BLOCK_SIZE];
+
+  /* For each block-column of C */
+  for (int j = 0; j < N; j += SMALL_BLOCK_SIZE)
+  {
+    int NN = min(SMALL_BLOCK_SIZE, N - j);
+
+    /* For each block-row of C */
+    for (int i = 0; i < M; i += SMALL_BLOCK_SIZE)
+    {
+      int MM = min(SMALL_BLOCK_SIZE, M - i);
+
+      // pack A only once
+      if (j == 0)
+      {
+        pack_a(K, MM, lda, A + i, AA + i * K);
+      }
+
+      // the next tile of C, before its accumulators are loaded
+      if (prefetch_distance && i + SMALL_BLOCK_SIZE < M)
+        prefetch_tile(ldc, C + i + SMALL_BLOCK_SIZE + j * ldc);
+
+      /* Perform individual block sgemm */
+      do_block_edge(MM, NN, K, AA + i * K, BP + j * K, ldc, C + i + j * ldc);
+    }
+  }
+}
+
+// products with N (or M) up to SKINNY_MAX are matrix-vector like: each element
+// of the big operand is used at most SKINNY_MAX times, so instead of padding
+// 8x8 tiles they stream it once at memory bandwidth
+#define SKINNY_MAX SMALL_BLOCK_SIZE
+
+// rows of A (in vectors of 4) per strip of the skinny-N kernel, and columns
+// of A it goes down at a time
+#define SKINNY_V 8
+#define SKINNY_N_KC 64
+
+// columns of A, rows of B, packed at a time by the skinny-M kernel
+#define SKINNY_M_KC 512
+
+// C: (4 * V) x NN strip, kept in registers over K
+// A read in place, B[k, j] broadcast; V and NN are constant once inlined
+static inline __attribute__((always_inline)) void skinny_n_strip(int V, int NN, int K, int lda, const float *restrict A, int ldb, const float *restrict B, int ldc, float *restrict C)
+{
+  float32x4_t acc[SKINNY_V][SKINNY_MAX];
+  float32x4_t a[SKINNY_V];
+
+#pragma GCC unroll 8
+  for (int j = 0; j < NN; j++)
+#pragma GCC unroll 8
+    for (int v = 0; v < V; v++)
+      acc[v][j] = vld1q_f32(C + 4 * v + j * ldc);
+
+  for (int k = 0; k < K; k++)
+  {
+#pragma GCC unroll 8
+    for (int v = 0; v < V; v++)
+      a[v] = vld1q_f32(A + 4 * v + k * lda);
+#pragma GCC unroll 8
+    for (int j = 0; j < NN; j++)
+    {
+      float32x4_t b = vld1q_dup_f32(B + k + j * ldb);
+#pragma GCC unroll 8
+      for (int v = 0; v < V; v++)
+        acc[v][j] = vmlaq_f32(acc[v][j], a[v], b);
+    }
+  }
+
+#pragma GCC unroll 8
+  for (int j = 0; j < NN; j++)
+#pragma GCC unroll 8
+    for (int v = 0; v < V; v++)
+      vst1q_f32(C + 4 * v + j * ldc, acc[v][j]);
+}
+
+// strips of 4 * V rows with N a constant, about 16 accumulators each
+#define SKINNY_N_STRIPS(V, NN)                                                \
+  for (; i + 4 * (V) <= M; i += 4 * (V))                                      \
+    skinny_n_strip(V, NN, KC, lda, A + i + p * lda, ldb, B + p, ldc, C + i);
+
+// C += A * B for N <= SKINNY_MAX, sgemv when N == 1
+static inline void sgemm_skinny_n(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  /* For each block-column of A */
+  for (int p = 0; p < K; p += SKINNY_N_KC)
+  {
+    // going down the rows SKINNY_N_KC columns at a time keeps the pages of A
+    // being read in the TLB, the strips of C are reloaded once per block
+    int KC = min(SKINNY_N_KC, K - p);
+    int i = 0;
+    switch (N)
+    {
+    case 1: SKINNY_N_STRIPS(8, 1) break;
+    case 2: SKINNY_N_STRIPS(8, 2) break;
+    case 3: SKINNY_N_STRIPS(4, 3) break;
+    case 4: SKINNY_N_STRIPS(4, 4) break;
+    case 5: SKINNY_N_STRIPS(2, 5) break;
+    case 6: SKINNY_N_STRIPS(2, 6) break;
+    case 7: SKINNY_N_STRIPS(2, 7) break;
+    case 8: SKINNY_N_STRIPS(2, 8) break;
+    }
+
+    // the last rows one at a time
+    for (; i < M; i++)
+      for (int j = 0; j < N; j++)
+      {
+        float sum = 0;
+        for (int k = p; k < p + KC; k++)
+          sum += A[i + k * lda] * B[k + j * ldb];
+        C[i + j * ldc] += sum;
+      }
+  }
+}
+
+// C: MM x NJ, each element the dot product of a packed row of A (AT, rows
+// SKINNY_M_KC apart) with a column of B over K; MM and NJ are constant once inlined
+static inline __attribute__((always_inline)) void skinny_m_strip(int MM, int NJ, int K, const float *restrict AT, int ldb, const float *restrict B, int ldc, float *restrict C)
+{
+  float32x4_t acc[SKINNY_MAX][SKINNY_MAX];
+  int K4 = K / 4 * 4;
+
+#pragma GCC unroll 8
+  for (int i = 0; i < MM; i++)
+#pragma GCC unroll 8
+    for (int j = 0; j < NJ; j++)
+      acc[i][j] = vdupq_n_f32(0);
+
+  for (int k = 0; k < K4; k += 4)
+  {
+    float32x4_t b[SKINNY_MAX];
+#pragma GCC unroll 8
+    for (int j = 0; j < NJ; j++)
+      b[j] = vld1q_f32(B + k + j * ldb);
+#pragma GCC unroll 8
+    for (int i = 0; i < MM; i++)
+    {
+      float32x4_t a = vld1q_f32(AT + k + i * SKINNY_M_KC);
+#pragma GCC unroll 8
+      for (int j = 0; j < NJ; j++)
+        acc[i][j] = vmlaq_f32(acc[i][j], a, b[j]);
+    }
+  }
+
+#pragma GCC unroll 8
+  for (int i = 0; i < MM; i++)
+#pragma GCC unroll 8
+    for (int j = 0; j < NJ; j++)
+    {
+      float sum = vaddvq_f32(acc[i][j]);
+      for (int k = K4; k < K; k++)
+        sum += AT[k + i * SKINNY_M_KC] * B[k + j * ldb];
+      C[i + j * ldc] += sum;
+    }
+}
+
+// NJ columns of B at a time with M a constant, then the leftover columns
+#define SKINNY_M_COLUMNS(MM, NJ)                                              \
+  for (; j + (NJ) <= N; j += (NJ))                                            \
+    skinny_m_strip(MM, NJ, KC, AT, ldb, B + p + j * ldb, ldc, C + j * ldc);   \
+  for (; j < N; j++)                                                          \
+    skinny_m_strip(MM, 1, KC, AT, ldb, B + p + j * ldb, ldc, C + j * ldc);
+
+// C += A * B for M <= SKINNY_MAX, a row vector times a matrix when M == 1
+// B is streamed once down its contiguous columns
+static inline void sgemm_skinny_m(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  float AT[SKINNY_MAX * SKINNY_M_KC];
+
+  /* For each block-row of B */
+  for (int p = 0; p < K; p += SKINNY_M_KC)
+  {
+    int KC = min(SKINNY_M_KC, K - p);
+    // rows of A made contiguous, so both operands are read with vector loads
+    for (int k = 0; k < KC; k++)
+      for (int i = 0; i < M; i++)
+        AT[k + i * SKINNY_M_KC] = A[i + (p + k) * lda];
+
+    int j = 0;
+    switch (M)
+    {
+    case 1: SKINNY_M_COLUMNS(1, 8) break;
+    case 2: SKINNY_M_COLUMNS(2, 4) break;
+    case 3: SKINNY_M_COLUMNS(3, 4) break;
+    case 4: SKINNY_M_COLUMNS(4, 4) break;
+    case 5: SKINNY_M_COLUMNS(5, 2) break;
+    case 6: SKINNY_M_COLUMNS(6, 2) break;
+    case 7: SKINNY_M_COLUMNS(7, 2) break;
+    case 8: SKINNY_M_COLUMNS(8, 2) break;
+    }
+  }
+}
+
+// rank-k updates with K up to RANK_K_MAX skip the two-level blocking
+#if !defined(RANK_K_MAX)
+#define RANK_K_MAX 64
+#endif
+
+// columns of B packed at a time by the rank-k path, and rows of A
+// kept in cache while they are multiplied with them
+#define RANK_K_NC 256
+#define RANK_K_MC 512
+
+// C := C + A * B for small K, e.g. M = N = 4096, K = 16
+// each element of A and B is only used K times per tile of C, so packing
+// everything costs about as much as the multiply: A is read in place, 8 rows
+// at a time, and only the narrow B is packed, RANK_K_NC columns at a time.
+// Every 8x8 tile of C is loaded, updated with the whole K and stored once,
+// walking down the columns of C like the blocked path
+static inline void sgemm_rank_k(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  float AA[RANK_K_MAX * SMALL_BLOCK_SIZE];
+  float BB[RANK_K_MAX * RANK_K_NC];
+
+  for (int jc = 0; jc < N; jc += RANK_K_NC)
+  {
+    int NC = min(RANK_K_NC, N - jc);
+    for (int j = 0; j < NC; j += SMALL_BLOCK_SIZE)
+    {
+      pack_b(K, min(SMALL_BLOCK_SIZE, NC - j), ldb, B + (jc + j) * ldb, BB + j * K);
+    }
+
+    /* For each block-row of A */
+    for (int ic = 0; ic < M; ic += RANK_K_MC)
+    {
+      int MC = min(RANK_K_MC, M - ic);
+
+      /* For each block-column of C */
+      for (int j = 0; j < NC; j += SMALL_BLOCK_SIZE)
+      {
+        int NN = min(SMALL_BLOCK_SIZE, NC - j);
+
+        /* For each block-row of C */
+        for (int i = ic; i < ic + MC; i += SMALL_BLOCK_SIZE)
+        {
+          int MM = min(SMALL_BLOCK_SIZE, ic + MC - i);
+          float *CT = C + i + (jc + j) * ldc;
+
+          // C is streamed through once, so it is always worth fetching ahead,
+          // a cache line holds two tiles of a column
+          if (i + 2 * SMALL_BLOCK_SIZE < ic + MC)
+            prefetch_tile(ldc, CT + 2 * SMALL_BLOCK_SIZE);
+
+          if (MM == SMALL_BLOCK_SIZE && NN == SMALL_BLOCK_SIZE)
+          {
+            // A with row stride lda: only the intrinsic kernel takes any stride,
+            // a DO_BLOCK_SMALL substitute may assume packed panels
+            do_block_small(K, SMALL_BLOCK_SIZE, A + i, lda, BB + j * K, ldc, CT);
+          }
+          else
+          {
+            // edge tiles are rare, pack the rows with zero padding
+            pack_a(K, MM, lda, A + i, AA);
+            do_block_edge(MM, NN, K, AA, BB + j * K, ldc, CT);
+          }
+        }
+      }
+    }
+  }
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A is M-by-K, B is K-by-N and C is M-by-N, stored in column-major format
+ * with leading dimensions lda, ldb and ldc. */
+static inline void sgemm_blocked(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C)
+{
+  if (N <= SKINNY_MAX)
+  {
+    sgemm_skinny_n(M, N, K, lda, A, ldb, B, ldc, C);
+    return;
+  }
+  if (M <= SKINNY_MAX)
+  {
+    sgemm_skinny_m(M, N, K, lda, A, ldb, B, ldc, C);
+    return;
+  }
+  if (K <= RANK_K_MAX)
+  {
+    sgemm_rank_k(M, N, K, lda, A, ldb, B, ldc, C);
+    return;
+  }
+
+  /* For each block-row of A */
+  for (int i = 0; i < M; i += BLOCK_SIZE)
+  {
+    int MM = min(BLOCK_SIZE, M - i);
+    /* For each block-column of A */
+    for (int j = 0; j < K; j += BLOCK_SIZE)
+    {
+      int KK = min(BLOCK_SIZE, K - j);
+
+      do_block_large(MM, N, KK, lda, A + i + j * lda, ldb, B + j, ldc, C + i);
+    }
+  }
+}
+
+// element (i, j) of a strided matrix X is X[i * rs + j * cs]: column-major is
+// rs = 1, cs = ld, row-major is rs = ld, cs = 1, other strides are sliced views
+
+// pack MM x K panel of strided A into AA as pack_a lays it out: column-major
+// is pack_a itself, row-major rows are contiguous in k like the columns of B
+// so the transposing pack_b does it, anything else is gathered element-wise
+static inline void pack_a_strided(int K, int MM, int rs, int cs, const float *restrict A, float *restrict AA)
+{
+  if (rs == 1)
+    pack_a(K, MM, cs, A, AA);
+  else if (cs == 1)
+    pack_b(K, MM, rs, A, AA);
+  else
+  {
+    for (int k = 0; k < K; k++)
+    {
+      for (int ii = 0; ii < SMALL_BLOCK_SIZE; ii++)
+      {
+        AA[ii + k * SMALL_BLOCK_SIZE] = ii < MM ? A[ii * rs + k * cs] : 0.0f;
+      }
+    }
+  }
+}
+
+// pack K x NN panel of strided B into BB as pack_b lays it out,
+// a row-major panel is a plain copy
+static inline void pack_b_strided(int K, int NN, int rs, int cs, const float *restrict B, float *restrict BB)
+{
+  if (rs == 1)
+    pack_b(K, NN, cs, B, BB);
+  else if (cs == 1)
+    pack_a(K, NN, rs, B, BB);
+  else
+  {
+    for (int k = 0; k < K; k++)
+    {
+      for (int jj = 0; jj < SMALL_BLOCK_SIZE; jj++)
+      {
+        BB[jj + k * SMALL_BLOCK_SIZE] = jj < NN ? B[k * rs + jj * cs] : 0.0f;
+      }
+    }
+  }
+}
+
+// do_block_edge for a tile of C with non-unit row stride, through the CC copy
+static inline void do_block_strided(int MM, int NN, int K, float *restrict AA, float *restrict BB, int rs, int cs, float *restrict C)
+{
+  float CC[SMALL_BLOCK_SIZE * SMALL_BLOCK_SIZE];
+
+  for (int jj = 0; jj < NN; jj++)
+  {
+    for (int ii = 0; ii < MM; ii++)
+    {
+      CC[ii + jj * SMALL_BLOCK_SIZE] = C[ii * rs + jj * cs];
+    }
+  }
+  DO_BLOCK_SMALL(K, SMALL_BLOCK_SIZE, AA, SMALL_BLOCK_SIZE, BB, SMALL_BLOCK_SIZE, CC);
+
+  for (int jj = 0; jj < NN; jj++)
+  {
+    for (int ii = 0; ii < MM; ii++)
+    {
+      C[ii * rs + jj * cs] = CC[ii + jj * SMALL_BLOCK_SIZE];
+    }
+  }
+}
+
+// do_block_large on strided operands, the strides are handled while packing
+// M and K must not exceed BLOCK_SIZE
+static inline void do_block_large_strided(int M, int N, int K, float *A, int rsa, int csa, float *B, int rsb, int csb, float *C, int rsc, int csc)
+{
+  // buffer for packing
+  float AA[BLOCK_SIZE * BLOCK_SIZE];
+  float BB[BLOCK_SIZE * SMALL_BLOCK_SIZE];
+
+  /* For each block-column of C */
+  for (int j = 0; j < N; j += SMALL_BLOCK_SIZE)
+  {
+    int NN = min(SMALL_BLOCK_SIZE, N - j);
+    pack_b_strided(K, NN, rsb, csb, B + j * csb, BB);
+
+    /* For each block-row of C */
+    for (int i = 0; i < M; i += SMALL_BLOCK_SIZE)
+    {
+      int MM = min(SMALL_BLOCK_SIZE, M - i);
+
+      // pack A only once
+      if (j == 0)
+      {
+        pack_a_strided(K, MM, rsa, csa, A + i * rsa, AA + i * K);
+      }
+
+      if (rsc == 1)
+        do_block_edge(MM, NN, K, AA + i * K, BB, csc, C + i + j * csc);
+      else
+        do_block_strided(MM, NN, K, AA + i * K, BB, rsc, csc, C + i * rsc + j * csc);
+    }
+  }
+}
+
+/* This routine performs a sgemm operation
+ *  C := C + A * B
+ * where A is M-by-K, B is K-by-N and C is M-by-N, each with its own row and
+ * column stride, without transposing anything up front. */
+static inline void sgemm_strided_blocked(int M, int N, int K, float *A, int rsa, int csa, float *B, int rsb, int csb, float *C, int rsc, int csc)
+{
+  // a row-major C is the column-major C^T := C^T + B^T * A^T
+  if (rsc != 1 && csc == 1)
+  {
+    sgemm_strided_blocked(N, M, K, B, csb, rsb, A, csa, rsa, C, csc, rsc);
+    return;
+  }
+
+  // all column-major: the shape-aware paths of sgemm_blocked apply
+  if (rsa == 1 && rsb == 1 && rsc == 1)
+  {
+    sgemm_blocked(M, N, K, csa, A, csb, B, csc, C);
+    return;
+  }
+
+  /* For each block-row of A */
+  for (int i = 0; i < M; i += BLOCK_SIZE)
+  {
+    int MM = min(BLOCK_SIZE, M - i);
+    /* For each block-column of A */
+    for (int j = 0; j < K; j += BLOCK_SIZE)
+    {
+      int KK = min(BLOCK_SIZE, K - j);
+
+      do_block_large_strided(MM, N, KK, A + i * rsa + j * csa, rsa, csa, B + j * rsb, rsb, csb, C + i * rsc, rsc, csc);
+    }
+  }
+}
+
+#endif
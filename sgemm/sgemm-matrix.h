@@ -0,0 +1,129 @@
+// binary matrix files: operands captured from a real caller, replayed by the
+// benchmark without copying them
+// a file is a 64-byte header followed by the elements, element (i, j) at
+// data[i * rs + j * cs] counted from the start of the data
+// the including file must define _GNU_SOURCE before any other include
+#ifndef SGEMM_MATRIX_H
+#define SGEMM_MATRIX_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MATRIX_MAGIC "SGEMMMAT"
+#define MATRIX_VERSION 1
+// the data starts on a cache line
+#define MATRIX_HEADER_SIZE 64
+
+enum
+{
+  // 32-bit IEEE float, the only element type so far
+  MATRIX_F32,
+};
+
+// on disk in the byte order of the machine that wrote it
+struct matrix_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t dtype;
+  int64_t rows, cols;
+  int64_t rs, cs;
+  // offset of the data from the start of the file
+  uint64_t offset;
+  // 'C' column-major, 'R' row-major or 'S' any other strides, informational
+  char layout;
+  char reserved[7];
+};
+
+struct matrix
+{
+  struct matrix_header h;
+  // the elements inside the mapping, writable but private to the process
+  float *data;
+  void *map;
+  size_t length;
+};
+
+// elements spanned by a rows-by-cols matrix with strides rs and cs
+static inline size_t matrix_extent(int64_t rows, int64_t cols, int64_t rs, int64_t cs)
+{
+  return (size_t)((rows - 1) * rs + (cols - 1) * cs + 1);
+}
+
+static inline char matrix_layout(int64_t rows, int64_t cols, int64_t rs, int64_t cs)
+{
+  if (rs == 1 && cs >= rows)
+    return 'C';
+  if (cs == 1 && rs >= cols)
+    return 'R';
+  return 'S';
+}
+
+// write the span of X holding the rows-by-cols matrix; returns 0 on failure
+static inline int matrix_write(const char *path, int64_t rows, int64_t cols, int64_t rs, int64_t cs, const float *X)
+{
+  struct matrix_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, MATRIX_MAGIC, sizeof(h.magic));
+  h.version = MATRIX_VERSION;
+  h.dtype = MATRIX_F32;
+  h.rows = rows;
+  h.cols = cols;
+  h.rs = rs;
+  h.cs = cs;
+  h.offset = MATRIX_HEADER_SIZE;
+  h.layout = matrix_layout(rows, cols, rs, cs);
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL)
+    return 0;
+  size_t count = matrix_extent(rows, cols, rs, cs);
+  int ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(X, sizeof(float), count, f) == count;
+  return fclose(f) == 0 && ok;
+}
+
+// map the file copy-on-write, the elements are used in place; returns 0 when
+// the file cannot be mapped, is not a matrix file or is shorter than its matrix
+static inline int matrix_map(const char *path, struct matrix *m)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct matrix_header))
+  {
+    close(fd);
+    return 0;
+  }
+  m->length = st.st_size;
+  m->map = mmap(NULL, m->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m->map == MAP_FAILED)
+    return 0;
+
+  memcpy(&m->h, m->map, sizeof(m->h));
+  struct matrix_header *h = &m->h;
+  int ok = memcmp(h->magic, MATRIX_MAGIC, sizeof(h->magic)) == 0 && h->version == MATRIX_VERSION &&
+           h->dtype == MATRIX_F32 && h->rows > 0 && h->cols > 0 && h->rs > 0 && h->cs > 0 &&
+           h->offset % sizeof(float) == 0 && h->offset <= m->length &&
+           matrix_extent(h->rows, h->cols, h->rs, h->cs) <= (m->length - h->offset) / sizeof(float);
+  if (!ok)
+  {
+    munmap(m->map, m->length);
+    return 0;
+  }
+  m->data = (float *)((char *)m->map + h->offset);
+  return 1;
+}
+
+static inline void matrix_unmap(struct matrix *m)
+{
+  munmap(m->map, m->length);
+}
+
+#endif
@@ -0,0 +1,281 @@
+// persistent thread pool pinned along the NUMA topology, shared by the parallel variants
+// the including file must define _GNU_SOURCE before any other include
+#ifndef SGEMM_POOL_H
+#define SGEMM_POOL_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sgemm-denormal.h"
+
+#define MAX_THREADS 256
+#define MAX_NODES 64
+
+typedef void (*pool_fn)(void *arg, int tid);
+
+// placement of the threads, SGEMM_AFFINITY or sgemm_set_threads:
+// numa    spread over the nodes in proportion to their cpu count, neighbouring cpus within a node
+// compact fill the cpus of one node before using the next
+// scatter the same number of threads on every node, spaced out within each node
+enum
+{
+  AFFINITY_NUMA,
+  AFFINITY_COMPACT,
+  AFFINITY_SCATTER,
+};
+
+static struct
+{
+  int nthreads;
+  // number of nodes that got at least one thread, numbered 0..nnodes-1
+  int nnodes;
+  // per thread: cpu it is pinned to, node it belongs to, rank within that node
+  int cpu[MAX_THREADS];
+  int node[MAX_THREADS];
+  int rank[MAX_THREADS];
+  // per node: number of threads
+  int node_threads[MAX_NODES];
+
+  // bumped by every pool_start, variants rebuild their per-thread state when it changes
+  int generation;
+
+  pthread_t threads[MAX_THREADS];
+  pthread_barrier_t start, done;
+  pool_fn fn;
+  void *arg;
+  // floating-point control of the caller of pool_run, the threads run with it
+  uint64_t fp_control;
+} pool;
+
+// parse a sysfs cpulist such as "0-31,64-95" into cpus, keeping only allowed ones
+static int parse_cpulist(const char *path, cpu_set_t *allowed, int *cpus, int max)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+    return 0;
+  int n = 0, lo, hi;
+  while (fscanf(f, "%d", &lo) == 1)
+  {
+    hi = lo;
+    int c = fgetc(f);
+    if (c == '-')
+    {
+      if (fscanf(f, "%d", &hi) != 1)
+        break;
+      c = fgetc(f);
+    }
+    for (int cpu = lo; cpu <= hi && n < max; cpu++)
+      if (CPU_ISSET(cpu, allowed))
+        cpus[n++] = cpu;
+    if (c != ',')
+      break;
+  }
+  fclose(f);
+  return n;
+}
+
+// fill node_cpus/node_ncpus from /sys/devices/system/node, or a single node
+// with every allowed cpu if the machine does not expose one
+static int read_topology(int node_cpus[][CPU_SETSIZE], int *node_ncpus)
+{
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed))
+  {
+    CPU_ZERO(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      CPU_SET(cpu, &allowed);
+  }
+
+  int nnodes = 0;
+  for (int node = 0; node < MAX_NODES; node++)
+  {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    int n = parse_cpulist(path, &allowed, node_cpus[nnodes], CPU_SETSIZE);
+    if (n > 0)
+      node_ncpus[nnodes++] = n;
+  }
+
+  if (nnodes == 0)
+  {
+    int n = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &allowed))
+        node_cpus[0][n++] = cpu;
+    node_ncpus[0] = n > 0 ? n : 1;
+    nnodes = 1;
+  }
+  return nnodes;
+}
+
+static void pin_to_cpu(int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *pool_worker(void *arg)
+{
+  int tid = (int)(intptr_t)arg;
+  pin_to_cpu(pool.cpu[tid]);
+  for (;;)
+  {
+    pthread_barrier_wait(&pool.start);
+    // pool_stop
+    if (pool.fn == NULL)
+      return NULL;
+    fp_control_set(pool.fp_control);
+    pool.fn(pool.arg, tid);
+    pthread_barrier_wait(&pool.done);
+  }
+  return NULL;
+}
+
+static int parse_affinity(const char *name)
+{
+  if (strcmp(name, "numa") == 0)
+    return AFFINITY_NUMA;
+  if (strcmp(name, "compact") == 0)
+    return AFFINITY_COMPACT;
+  if (strcmp(name, "scatter") == 0)
+    return AFFINITY_SCATTER;
+  return -1;
+}
+
+// start nthreads threads (0: one per allowed cpu) placed by affinity,
+// numbered contiguously within each node
+static void pool_start(int nthreads, int affinity)
+{
+  static int node_cpus[MAX_NODES][CPU_SETSIZE];
+  int node_ncpus[MAX_NODES];
+  int nnodes = read_topology(node_cpus, node_ncpus);
+
+  int total = 0;
+  for (int node = 0; node < nnodes; node++)
+    total += node_ncpus[node];
+
+  if (nthreads < 1)
+    nthreads = total;
+  if (nthreads > MAX_THREADS)
+    nthreads = MAX_THREADS;
+  // oversubscribed, every policy ends up on every cpu
+  if (nthreads > total)
+    affinity = AFFINITY_NUMA;
+
+  // threads per node
+  int count[MAX_NODES];
+  int left = nthreads, seen = 0, given = 0;
+  for (int node = 0; node < nnodes; node++)
+  {
+    seen += node_ncpus[node];
+    if (affinity == AFFINITY_COMPACT)
+      count[node] = left < node_ncpus[node] ? left : node_ncpus[node];
+    else if (affinity == AFFINITY_SCATTER)
+      count[node] = 0;
+    else
+      count[node] = (node == nnodes - 1 ? nthreads : (int)((long)nthreads * seen / total)) - given;
+    left -= count[node];
+    given += count[node];
+  }
+  // scatter: one thread per node in turn, skipping nodes whose cpus are all
+  // taken, so uneven nodes (cpuset or cgroup masks) never share a cpu while
+  // another node has one idle; nthreads <= total here
+  while (affinity == AFFINITY_SCATTER && left > 0)
+  {
+    for (int node = 0; node < nnodes && left > 0; node++)
+    {
+      if (count[node] < node_ncpus[node])
+      {
+        count[node]++;
+        left--;
+      }
+    }
+  }
+
+  pool.nthreads = nthreads;
+  pool.nnodes = 0;
+  int tid = 0;
+  for (int node = 0; node < nnodes; node++)
+  {
+    if (count[node] == 0)
+      continue;
+    for (int r = 0; r < count[node]; tid++, r++)
+    {
+      // scatter spreads its threads evenly over the node's cpu list; whether that
+      // keeps them off SMT siblings depends on the numbering (on x86 siblings are
+      // usually the number of cores apart, not neighbours)
+      int c = affinity == AFFINITY_SCATTER ? (int)((long)r * node_ncpus[node] / count[node]) : r;
+      pool.cpu[tid] = node_cpus[node][c % node_ncpus[node]];
+      pool.node[tid] = pool.nnodes;
+      pool.rank[tid] = r;
+    }
+    pool.node_threads[pool.nnodes++] = count[node];
+  }
+  pool.generation++;
+
+  pthread_barrier_init(&pool.start, NULL, nthreads + 1);
+  pthread_barrier_init(&pool.done, NULL, nthreads + 1);
+  for (int t = 0; t < nthreads; t++)
+    pthread_create(&pool.threads[t], NULL, pool_worker, (void *)(intptr_t)t);
+}
+
+// threads from SGEMM_NUM_THREADS, default one per allowed cpu,
+// placed by SGEMM_AFFINITY, default numa
+static void pool_init()
+{
+  char *env = getenv("SGEMM_NUM_THREADS");
+  int nthreads = env ? atoi(env) : 0;
+  if (env && nthreads < 1)
+    nthreads = 1;
+  env = getenv("SGEMM_AFFINITY");
+  int affinity = env ? parse_affinity(env) : AFFINITY_NUMA;
+  pool_start(nthreads, affinity < 0 ? AFFINITY_NUMA : affinity);
+}
+
+// let the threads exit, the next pool_run starts a new pool
+static void pool_stop()
+{
+  if (pool.nthreads == 0)
+    return;
+  pool.fn = NULL;
+  pthread_barrier_wait(&pool.start);
+  for (int t = 0; t < pool.nthreads; t++)
+    pthread_join(pool.threads[t], NULL);
+  pthread_barrier_destroy(&pool.start);
+  pthread_barrier_destroy(&pool.done);
+  pool.nthreads = 0;
+}
+
+// run fn(arg, tid) on every pool thread and wait for all of them
+// not reentrant: one caller at a time
+static void pool_run(pool_fn fn, void *arg)
+{
+  if (pool.nthreads == 0)
+    pool_init();
+  pool.fn = fn;
+  pool.arg = arg;
+  pool.fp_control = fp_control_get();
+  pthread_barrier_wait(&pool.start);
+  pthread_barrier_wait(&pool.done);
+}
+
+// restart the pool with nthreads threads (0: one per allowed cpu) placed by
+// affinity, "numa", "compact" or "scatter"; returns 0 and leaves the pool
+// alone for an unknown affinity; the variants export it as sgemm_set_threads
+static inline int pool_set_threads(int nthreads, const char *affinity)
+{
+  int policy = parse_affinity(affinity);
+  if (policy < 0)
+    return 0;
+  pool_stop();
+  pool_start(nthreads, policy);
+  return 1;
+}
+
+#endif
@@ -0,0 +1,87 @@
+// fine-grained clocks of the benchmarks: a fixed-rate counter for wall time,
+// the virtual counter CNTVCT_EL0 on AArch64 and the time stamp counter (rdtscp)
+// on x86-64, calibrated once against CLOCK_MONOTONIC_RAW, and the effective
+// core clock for rates per cycle
+// the including file must define _GNU_SOURCE before any other include
+#ifndef SGEMM_TIMER_H
+#define SGEMM_TIMER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__aarch64__) || defined(__x86_64__)
+#define TIMER_COUNTER
+#endif
+
+static inline uint64_t timer_ticks()
+{
+#if defined(__aarch64__)
+  uint64_t t;
+  // isb: the read must not be hoisted above the code being timed
+  __asm__ volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(t) : : "memory");
+  return t;
+#elif defined(__x86_64__)
+  // rdtscp waits for the instructions before it to complete
+  uint32_t lo, hi, aux;
+  __asm__ volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux) : : "memory");
+  return (uint64_t)hi << 32 | lo;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+static double raw_seconds()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+  return 1. * t.tv_sec + 1.e-9 * t.tv_nsec;
+}
+
+// ticks per second, 0 until the first timer_seconds
+static double timer_hz = 0;
+
+// count ticks across 20 ms of CLOCK_MONOTONIC_RAW, which NTP does not slew
+static void timer_calibrate()
+{
+#if defined(TIMER_COUNTER)
+  double t0 = raw_seconds();
+  uint64_t c0 = timer_ticks();
+  double t1;
+  while ((t1 = raw_seconds()) - t0 < 0.02)
+    ;
+  timer_hz = (timer_ticks() - c0) / (t1 - t0);
+#else
+  timer_hz = 1.e9;
+#endif
+}
+
+static double timer_seconds()
+{
+  if (timer_hz == 0)
+    timer_calibrate();
+  return timer_ticks() / timer_hz;
+}
+
+// effective core clock in Hz right now: a chain of dependent decrements
+// retires one per cycle, whatever turbo or DVFS have done to the clock;
+// 0 on targets without one
+static inline double core_hz(long iterations)
+{
+#if defined(TIMER_COUNTER)
+  long n = iterations;
+  double t = -timer_seconds();
+#if defined(__aarch64__)
+  __asm__ volatile("1:\n\tsubs %0, %0, #1\n\tb.ne 1b" : "+r"(n) : : "cc");
+#else
+  __asm__ volatile("1:\n\tdec %0\n\tjnz 1b" : "+r"(n) : : "cc");
+#endif
+  t += timer_seconds();
+  return iterations / t;
+#else
+  return 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,335 @@
+// call tracing of the library entry points, off unless SGEMM_TRACE names a file
+// every calling thread records its calls in a ring of its own, without locks;
+// the ring of an exited thread goes to the next new thread, its calls kept;
+// at exit the shape histogram and the calls still in the rings are written to
+// that file as a trace the benchmark replays with -R
+// SGEMM_TRACE_CALLS  calls kept per thread, default TRACE_CALLS
+// SGEMM_TRACE_OPERANDS  directory the operands of the first call of every shape
+//                       on every thread are written to, as matrix files for -m
+// the including file must define _GNU_SOURCE before any other include
+#ifndef SGEMM_TRACE_H
+#define SGEMM_TRACE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sgemm-matrix.h"
+
+#if !defined(TRACE_CALLS)
+#define TRACE_CALLS 65536
+#endif
+// distinct shapes counted per thread, the rest only in the total
+#define TRACE_SHAPES 1024
+
+struct trace_call
+{
+  int m, n, k;
+  int rsa, csa, rsb, csb, rsc, csc;
+  int thread;
+  uint64_t start, ns;
+};
+
+struct trace_shape
+{
+  int m, n, k;
+  // the last thread whose operands of the shape were captured
+  int thread;
+  long calls;
+  uint64_t ns;
+};
+
+// written only by its thread, read by the dump at exit
+struct trace_ring
+{
+  struct trace_ring *next;
+  // on the free list while no thread owns the ring
+  struct trace_ring *next_free;
+  int thread;
+  // calls ever recorded, the last capacity of them are in call[]
+  long calls;
+  long capacity;
+  struct trace_call *call;
+  // open addressing on the shape, calls == 0 is a free slot
+  struct trace_shape shape[TRACE_SHAPES];
+  long other_calls;
+  uint64_t other_ns;
+};
+
+enum
+{
+  TRACE_UNKNOWN,
+  TRACE_OFF,
+  TRACE_ON,
+};
+
+static int trace_state = TRACE_UNKNOWN;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static const char *trace_path, *trace_operands;
+static long trace_capacity;
+// every ring, pushed onto the front by its thread
+static struct trace_ring *trace_rings;
+static int trace_threads;
+static __thread struct trace_ring *trace_ring;
+// rings of exited threads, handed over by the destructor of trace_key
+static struct trace_ring *trace_free;
+static pthread_mutex_t trace_free_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t trace_key;
+
+static uint64_t trace_ns()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static int compare_trace_call(const void *a, const void *b)
+{
+  uint64_t x = ((const struct trace_call *)a)->start, y = ((const struct trace_call *)b)->start;
+  return (x > y) - (x < y);
+}
+
+static int compare_trace_shape(const void *a, const void *b)
+{
+  uint64_t x = ((const struct trace_shape *)a)->ns, y = ((const struct trace_shape *)b)->ns;
+  return (x < y) - (x > y);
+}
+
+// calls of the ring still in it
+static long trace_kept(struct trace_ring *r)
+{
+  long calls = __atomic_load_n(&r->calls, __ATOMIC_ACQUIRE);
+  return calls < r->capacity ? calls : r->capacity;
+}
+
+// the histogram by total time, then the calls of all threads in order of their start
+static void trace_dump()
+{
+  FILE *f = fopen(trace_path, "w");
+  if (f == NULL)
+  {
+    perror(trace_path);
+    return;
+  }
+
+  long calls = 0, kept = 0, other_calls = 0;
+  uint64_t ns = 0, other_ns = 0;
+  struct trace_shape *shapes = (struct trace_shape *)malloc(sizeof(struct trace_shape) * TRACE_SHAPES);
+  if (shapes == NULL)
+  {
+    fclose(f);
+    return;
+  }
+  int nshapes = 0;
+  for (struct trace_ring *r = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); r; r = r->next)
+  {
+    calls += __atomic_load_n(&r->calls, __ATOMIC_ACQUIRE);
+    kept += trace_kept(r);
+    other_calls += r->other_calls;
+    other_ns += r->other_ns;
+    for (int i = 0; i < TRACE_SHAPES; i++)
+    {
+      struct trace_shape *s = &r->shape[i];
+      if (s->calls == 0)
+        continue;
+      ns += s->ns;
+      int j = 0;
+      while (j < nshapes && (shapes[j].m != s->m || shapes[j].n != s->n || shapes[j].k != s->k))
+        j++;
+      if (j == nshapes && nshapes == TRACE_SHAPES)
+      {
+        other_calls += s->calls;
+        other_ns += s->ns;
+        continue;
+      }
+      if (j == nshapes)
+        shapes[nshapes++] = *s;
+      else
+      {
+        shapes[j].calls += s->calls;
+        shapes[j].ns += s->ns;
+      }
+    }
+  }
+  ns += other_ns;
+  qsort(shapes, nshapes, sizeof(struct trace_shape), compare_trace_shape);
+
+  fprintf(f, "# sgemm trace: %ld calls on %d threads, the last %ld kept\n", calls, trace_threads, kept);
+  fprintf(f, "# shapes by total time\n");
+  fprintf(f, "#\tM\tN\tK\tcalls\tseconds\tGflop/s\tof time\n");
+  for (int i = 0; i < nshapes; i++)
+  {
+    struct trace_shape *s = &shapes[i];
+    fprintf(f, "#\t%d\t%d\t%d\t%ld\t%.3g\t%.3g\t%.1f%%\n", s->m, s->n, s->k, s->calls, 1.e-9 * s->ns,
+            2. * s->calls * s->m * s->n * s->k / s->ns, 100. * s->ns / ns);
+  }
+  if (other_calls)
+    fprintf(f, "#\tother shapes\t\t%ld\t%.3g\t\t%.1f%%\n", other_calls, 1.e-9 * other_ns, 100. * other_ns / ns);
+  free(shapes);
+
+  // the calls in the rings, whichever thread made them
+  struct trace_call *all = (struct trace_call *)malloc(sizeof(struct trace_call) * (kept ? kept : 1));
+  long n = 0;
+  if (all)
+  {
+    for (struct trace_ring *r = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); r; r = r->next)
+    {
+      long count = trace_kept(r);
+      for (long i = 0; i < count && n < kept; i++)
+        all[n++] = r->call[i];
+    }
+    qsort(all, n, sizeof(struct trace_call), compare_trace_call);
+  }
+  fprintf(f, "# M N K rsa csa rsb csb rsc csc seconds thread\n");
+  for (long i = 0; i < n; i++)
+  {
+    struct trace_call *c = &all[i];
+    fprintf(f, "%d %d %d %d %d %d %d %d %d %.9f %d\n", c->m, c->n, c->k, c->rsa, c->csa, c->rsb, c->csb,
+            c->rsc, c->csc, 1.e-9 * c->ns, c->thread);
+  }
+  free(all);
+  fclose(f);
+}
+
+// a thread with a ring exits: the ring stays on trace_rings for the dump and
+// waits on the free list for another thread
+static void trace_release(void *p)
+{
+  struct trace_ring *r = (struct trace_ring *)p;
+  pthread_mutex_lock(&trace_free_lock);
+  r->next_free = trace_free;
+  trace_free = r;
+  pthread_mutex_unlock(&trace_free_lock);
+}
+
+static void trace_init()
+{
+  trace_path = getenv("SGEMM_TRACE");
+  trace_operands = getenv("SGEMM_TRACE_OPERANDS");
+  const char *env = getenv("SGEMM_TRACE_CALLS");
+  trace_capacity = env && atol(env) > 0 ? atol(env) : TRACE_CALLS;
+  if (trace_path && *trace_path && pthread_key_create(&trace_key, trace_release) == 0)
+  {
+    atexit(trace_dump);
+    __atomic_store_n(&trace_state, TRACE_ON, __ATOMIC_RELEASE);
+  }
+  else
+    __atomic_store_n(&trace_state, TRACE_OFF, __ATOMIC_RELEASE);
+}
+
+// start of a call, 0 when tracing is off: one load and branch
+static inline uint64_t trace_start()
+{
+  int state = __atomic_load_n(&trace_state, __ATOMIC_ACQUIRE);
+  if (__builtin_expect(state == TRACE_OFF, 1))
+    return 0;
+  if (state == TRACE_UNKNOWN)
+  {
+    pthread_once(&trace_once, trace_init);
+    if (__atomic_load_n(&trace_state, __ATOMIC_ACQUIRE) == TRACE_OFF)
+      return 0;
+  }
+  return trace_ns();
+}
+
+// the ring of the calling thread, one left by an exited thread when there is
+// one, NULL when out of memory
+static struct trace_ring *trace_thread()
+{
+  if (trace_ring)
+    return trace_ring;
+  pthread_mutex_lock(&trace_free_lock);
+  struct trace_ring *r = trace_free;
+  if (r)
+    trace_free = r->next_free;
+  pthread_mutex_unlock(&trace_free_lock);
+
+  if (r == NULL)
+  {
+    r = (struct trace_ring *)calloc(1, sizeof(struct trace_ring));
+    if (r == NULL)
+      return NULL;
+    r->capacity = trace_capacity;
+    r->call = (struct trace_call *)malloc(sizeof(struct trace_call) * r->capacity);
+    if (r->call == NULL)
+    {
+      free(r);
+      return NULL;
+    }
+    r->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace_rings, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+  }
+  // the calls already in a reused ring keep the number of their thread
+  r->thread = __atomic_fetch_add(&trace_threads, 1, __ATOMIC_RELAXED);
+  pthread_setspecific(trace_key, r);
+  trace_ring = r;
+  return r;
+}
+
+// write A and B of a call as matrix files named after the shape and thread;
+// a matrix file holds at least one element, empty operands are left out
+static void trace_capture(struct trace_call *c, const float *A, const float *B)
+{
+  if (c->m <= 0 || c->n <= 0 || c->k <= 0)
+    return;
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/A-%dx%dx%d-%d.mat", trace_operands, c->m, c->n, c->k, c->thread);
+  matrix_write(path, c->m, c->k, c->rsa, c->csa, A);
+  snprintf(path, sizeof(path), "%s/B-%dx%dx%d-%d.mat", trace_operands, c->m, c->n, c->k, c->thread);
+  matrix_write(path, c->k, c->n, c->rsb, c->csb, B);
+}
+
+// end of a call that began at start, strides as in sgemm_strided
+static inline void trace_end(uint64_t start, int M, int N, int K, const float *A, int rsa, int csa,
+                             const float *B, int rsb, int csb, int rsc, int csc)
+{
+  if (__builtin_expect(start == 0, 1))
+    return;
+  uint64_t ns = trace_ns() - start;
+  struct trace_ring *r = trace_thread();
+  if (r == NULL)
+    return;
+
+  struct trace_call c = {M, N, K, rsa, csa, rsb, csb, rsc, csc, r->thread, start, ns};
+  r->call[r->calls % r->capacity] = c;
+  __atomic_store_n(&r->calls, r->calls + 1, __ATOMIC_RELEASE);
+
+  // linear probing from a hash of the shape
+  unsigned h = ((unsigned)M * 73856093u ^ (unsigned)N * 19349663u ^ (unsigned)K * 83492791u) % TRACE_SHAPES;
+  for (int probe = 0; probe < TRACE_SHAPES; probe++, h = (h + 1) % TRACE_SHAPES)
+  {
+    struct trace_shape *s = &r->shape[h];
+    if (s->calls && s->m == M && s->n == N && s->k == K)
+    {
+      s->calls++;
+      s->ns += ns;
+      // a reused ring: the first call of the shape on this thread
+      if (s->thread != r->thread)
+      {
+        s->thread = r->thread;
+        if (trace_operands)
+          trace_capture(&c, A, B);
+      }
+      return;
+    }
+    if (s->calls == 0)
+    {
+      s->m = M;
+      s->n = N;
+      s->k = K;
+      s->thread = r->thread;
+      s->calls = 1;
+      s->ns = ns;
+      if (trace_operands)
+        trace_capture(&c, A, B);
+      return;
+    }
+  }
+  r->other_calls++;
+  r->other_ns += ns;
+}
+
+#endif
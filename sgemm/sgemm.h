@@ -0,0 +1,60 @@
+// library interface beyond square_sgemm
+// all matrices are column-major, C := C + A * B
+#ifndef SGEMM_H
+#define SGEMM_H
+
+// C := C + A * B for A: M-by-K, B: K-by-N, C: M-by-N
+void sgemm_rect(int M, int N, int K, int lda, float *A, int ldb, float *B, int ldc, float *C);
+
+// C := C + A * B with element (i, j) of each matrix X at X[i * rsX + j * csX]:
+// column-major is rs = 1, cs = ld, row-major rs = ld, cs = 1, and other
+// strides describe sliced views; nothing is transposed up front
+void sgemm_strided(int M, int N, int K, float *A, int rsa, int csa, float *B, int rsb, int csb, float *C, int rsc, int csc);
+// the same with a layout per matrix, 'R' row-major or 'C' column-major, and its leading dimension
+void sgemm_layout(int M, int N, int K, char layout_a, int lda, float *A, char layout_b, int ldb, float *B, char layout_c, int ldc, float *C);
+
+// C := C + A * A^T on the lower (uplo 'L') or upper (uplo 'U') triangle of
+// the N-by-N matrix C, A: N-by-K; returns 0 when out of memory, C untouched
+int sgemm_syrk(char uplo, int N, int K, int lda, float *A, int ldc, float *C);
+// B := A * B in place, A: M-by-M lower (uplo 'L') or upper (uplo 'U') triangular, B: M-by-N
+void sgemm_trmm(char uplo, int M, int N, int lda, float *A, int ldb, float *B);
+
+// C := C + A * B on column-major matrices stored as raw floats in the files
+// a, b and c, which may be larger than memory; SGEMM_OOC_MEMORY (MiB, default
+// 1024) sizes the panels mapped in at once, consumed ones are written back and
+// dropped from the mapping (the page cache is up to the kernel); returns 1
+// without opening the files when M, N or K is 0, and 0 when one is negative, a
+// file cannot be mapped or is shorter than its matrix, or SGEMM_OOC_MEMORY is
+// not positive, C untouched
+int sgemm_file(int M, int N, int K, const char *a, const char *b, const char *c);
+
+// denormals in the calls from now on: 1 flushed to zero (FZ, or FTZ and DAZ),
+// 0 kept (gradual underflow), -1 the floating-point mode of the calling thread
+// as it is (default); the pool threads of the parallel variants follow the caller
+void sgemm_set_denormals(int mode);
+
+// software prefetch distance in k steps for the kernel and packing, 0 disables it
+void sgemm_set_prefetch(int distance);
+
+// B packed once into the kernel's panel layout, see sgemm-blocked-packed.c
+typedef struct sgemm_packed sgemm_packed_t;
+
+// pack the K-by-N matrix B, returns NULL when out of memory
+sgemm_packed_t *sgemm_pack_b(int K, int N, const float *B, int ldb);
+// C := C + A * B, A: M-by-K, C: M-by-N, with K and N taken from the packed B
+void sgemm_packed(int M, int lda, float *A, const sgemm_packed_t *B, int ldc, float *C);
+void sgemm_packed_free(sgemm_packed_t *B);
+
+// restart the thread pool of the parallel variants with nthreads threads
+// (0: one per allowed cpu) placed by affinity: "numa" (in proportion to the
+// cpus of each NUMA node), "compact" (fill one node first) or "scatter" (even
+// over the nodes, spaced out within them); returns 0 for an unknown affinity
+int sgemm_set_threads(int nthreads, const char *affinity);
+
+// per-thread accounting of the parallel variants since the last reset:
+// fills up to max entries of busy seconds, tasks run and tasks stolen,
+// returns the number of threads
+int sgemm_thread_stats(int max, double *busy, int *tasks, int *steals);
+void sgemm_thread_stats_reset(void);
+
+#endif